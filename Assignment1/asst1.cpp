@@ -14,6 +14,7 @@
 #include <string>
 #include <memory>
 #include <stdexcept>
+#include <cstring>
 // If your OS is LINUX, uncomment the line below.
 //#include <tr1/memory>
 
@@ -24,6 +25,7 @@
 
 #include "ppm.h"
 #include "glsupport.h"
+#include "frameloop.h"
 
 using namespace std;      // for string, vector, iostream and other standard C++ stuff
 // If your OS is LINUX, uncomment the line below.
@@ -58,6 +60,10 @@ static int g_rightClickX, g_rightClickY;    // coordinates for mouse right click
 
 static float g_whScale = 1.0; // for width-height scaling
 
+static FrameLoop g_frameLoop;
+static FramePacing g_pacing = PACING_VSYNC;   // --pacing vsync, benchmark or a rate in Hz
+static double g_pacingRate = 30.0;
+
 struct ShaderState {
     GlProgram program;
 
@@ -104,9 +110,9 @@ static const char* const g_shaderFiles[g_numShaders][2] = {
 static const char* const g_shaderFilesGl2[g_numShaders][2] = {
   {"./shaders/asst1-gl2.vshader", "./shaders/asst1-gl2.fshader"}
 };
-static vector<shared_ptr<ShaderState> > g_shaderStates; // our global shader states
+static vector<ShaderState> g_shaderStates; // our global shader states
 
-static shared_ptr<GlTexture> g_tex0, g_tex1, g_tex2; // our global texture instance
+static vector<GlTexture> g_tex; // our global texture instances (smiley, reachup, KMU logo)
 
 struct SquareGeometry {
 
@@ -283,7 +289,7 @@ struct TriangleGeometry {
 
         // ؽó   (KMU_LOGO )
         glActiveTexture(GL_TEXTURE0 + textureUnit);
-        glBindTexture(GL_TEXTURE_2D, *g_tex2);
+        glBindTexture(GL_TEXTURE_2D, g_tex[2]);
         safe_glUniform1i(curSS.h_uTexUnit0, textureUnit);
 
         glDrawArrays(GL_TRIANGLES, 0, numverts);
@@ -304,19 +310,16 @@ static shared_ptr<TriangleGeometry> g_triangle;
 
 // _____________________________________________________
 //|                                                     |
-//|  display                                            |
+//|  render                                             |
 //|_____________________________________________________|
 ///
-///  Whenever OpenGL requires a screen refresh
-///  it will call display() to draw the scene.
-///  We specify that this is the correct function
-///  to call with the glutDisplayFunc() function
-///  during initialization
+///  The frame loop calls render() once per frame to
+///  draw the scene, and swaps the buffers after it.
 
-static void display(void) {
+static void render(void) {
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    const ShaderState& curSS = *g_shaderStates[0];
+    const ShaderState& curSS = g_shaderStates[0];
     glUseProgram(curSS.program);
 
     safe_glUniform1i(curSS.h_uTexUnit0, 0);
@@ -327,13 +330,23 @@ static void display(void) {
     g_square->draw(curSS);
     g_triangle->draw(curSS, 2);
 
-    glutSwapBuffers();
-
     // check for errors
     checkGlErrors();
 }
 
 
+// _____________________________________________________
+//|                                                     |
+//|  display                                            |
+//|_____________________________________________________|
+///
+///  GLUT requires a display callback, but every frame
+///  is drawn by the frame loop, so there is nothing to
+///  do when the window needs a refresh.
+
+static void display(void) {}
+
+
 // _____________________________________________________
 //|                                                     |
 //|  reshape                                            |
@@ -425,10 +438,15 @@ void keyboard(unsigned char key, int x, int y) {
         cout << " ============== H E L P ==============\n\n"
             << "h\t\thelp menu\n"
             << "s\t\tsave screenshot\n"
+            << "i\t\tprint frame timing statistics\n"
             << "drag right mouse to change square size\n";
         break;
     case 'q':
-        exit(0);
+        g_frameLoop.stop();
+        break;
+    case 'i':
+        g_frameLoop.printStats(cout);
+        break;
     case 's':
         glFinish();
         writePpmScreenshot(g_width, g_height, "out.ppm");
@@ -463,12 +481,12 @@ static void initGLState() {
 }
 
 static void initShaders() {
-    g_shaderStates.resize(g_numShaders);
+    g_shaderStates.reserve(g_numShaders);
     for (int i = 0; i < g_numShaders; ++i) {
         if (g_Gl2Compatible)
-            g_shaderStates[i].reset(new ShaderState(g_shaderFilesGl2[i][0], g_shaderFilesGl2[i][1]));
+            g_shaderStates.push_back(ShaderState(g_shaderFilesGl2[i][0], g_shaderFilesGl2[i][1]));
         else
-            g_shaderStates[i].reset(new ShaderState(g_shaderFiles[i][0], g_shaderFiles[i][1]));
+            g_shaderStates.push_back(ShaderState(g_shaderFiles[i][0], g_shaderFiles[i][1]));
     }
 }
 
@@ -492,30 +510,28 @@ static void loadTexture(GLuint texHandle, const char* ppmFilename) {
 
 
 static void initTextures() {
-    g_tex0.reset(new GlTexture());
-    g_tex1.reset(new GlTexture());
-    g_tex2.reset(new GlTexture());
+    g_tex.resize(3);
 
-    loadTexture(*g_tex0, "smiley.ppm");
-    loadTexture(*g_tex1, "reachup.ppm");
-    loadTexture(*g_tex2, "KMU_LOGO.ppm");
+    loadTexture(g_tex[0], "smiley.ppm");
+    loadTexture(g_tex[1], "reachup.ppm");
+    loadTexture(g_tex[2], "KMU_LOGO.ppm");
 
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, *g_tex0);
+    glBindTexture(GL_TEXTURE_2D, g_tex[0]);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
 
     glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, *g_tex1);
+    glBindTexture(GL_TEXTURE_2D, g_tex[1]);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
 
     glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, *g_tex2);
+    glBindTexture(GL_TEXTURE_2D, g_tex[2]);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
@@ -537,6 +553,11 @@ int main(int argc, char** argv) {
     try {
         initGlutState(argc, argv);
 
+        for (int i = 1; i + 1 < argc; ++i) {
+            if (strcmp(argv[i], "--pacing") == 0)
+                g_pacing = FrameLoop::parsePacing(argv[++i], g_pacingRate);
+        }
+
         glewInit(); // load the OpenGL extensions
 
         cout << "GL ver: " << glGetString(GL_VERSION) << "\n";
@@ -554,7 +575,10 @@ int main(int argc, char** argv) {
         initGeometry();
         initTextures();
 
-        glutMainLoop();
+        FramePhases phases;
+        phases.render = render;
+        g_frameLoop.setPacing(g_pacing, g_pacingRate);
+        g_frameLoop.run(phases);
         return 0;
     }
     catch (const runtime_error& e) {
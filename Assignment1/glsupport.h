@@ -3,6 +3,7 @@
 
 #include <iostream>
 #include <stdexcept>
+#include <utility>
 
 #include <GL/glew.h>
 #ifdef __MAC__
@@ -40,6 +41,8 @@ private:
 
 // Light wrapper around a GL shader (can be geometry/vertex/fragment shader)
 // handle. Automatically allocates and deallocates. Can be casted to GLuint.
+// The wrappers below are movable, so they can be stored by value in containers.
+// A moved-from wrapper holds name 0, which GL silently ignores deleting.
 class GlShader : Noncopyable {
 protected:
   GLuint handle_;
@@ -52,6 +55,15 @@ public:
     checkGlErrors();
   }
 
+  GlShader(GlShader&& other) noexcept : handle_(other.handle_) {
+    other.handle_ = 0;
+  }
+
+  GlShader& operator= (GlShader&& other) noexcept {
+    std::swap(handle_, other.handle_);
+    return *this;
+  }
+
   ~GlShader() {
     glDeleteShader(handle_);
   }
@@ -76,6 +88,15 @@ public:
     checkGlErrors();
   }
 
+  GlProgram(GlProgram&& other) noexcept : handle_(other.handle_) {
+    other.handle_ = 0;
+  }
+
+  GlProgram& operator= (GlProgram&& other) noexcept {
+    std::swap(handle_, other.handle_);
+    return *this;
+  }
+
   ~GlProgram() {
     glDeleteProgram(handle_);
   }
@@ -99,6 +120,15 @@ public:
     checkGlErrors();
   }
 
+  GlTexture(GlTexture&& other) noexcept : handle_(other.handle_) {
+    other.handle_ = 0;
+  }
+
+  GlTexture& operator= (GlTexture&& other) noexcept {
+    std::swap(handle_, other.handle_);
+    return *this;
+  }
+
   ~GlTexture() {
     glDeleteTextures(1, &handle_);
   }
@@ -121,6 +151,15 @@ public:
         checkGlErrors();
     }
 
+    GlVertexArrayObject(GlVertexArrayObject&& other) noexcept : handle_(other.handle_) {
+        other.handle_ = 0;
+    }
+
+    GlVertexArrayObject& operator= (GlVertexArrayObject&& other) noexcept {
+        std::swap(handle_, other.handle_);
+        return *this;
+    }
+
     ~GlVertexArrayObject() {
         glDeleteVertexArrays(1, &handle_);
     }
@@ -144,6 +183,15 @@ public:
     checkGlErrors();
   }
 
+  GlBufferObject(GlBufferObject&& other) noexcept : handle_(other.handle_) {
+    other.handle_ = 0;
+  }
+
+  GlBufferObject& operator= (GlBufferObject&& other) noexcept {
+    std::swap(handle_, other.handle_);
+    return *this;
+  }
+
   ~GlBufferObject() {
     glDeleteBuffers(1, &handle_);
   }
@@ -0,0 +1,137 @@
+#ifndef AGENTS_H
+#define AGENTS_H
+
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+#include "cvec.h"
+#include "bounds.h"
+#include "collision.h"
+#include "jobs.h"
+#include "maze.h"
+#include "profiler.h"
+
+//--------------------------------------------------------------------------------
+// Many spheres wandering on the ground plane among the walls
+//--------------------------------------------------------------------------------
+
+
+// A crowd of agents of one radius at one height, each walking at a constant
+// speed along a heading that drifts at random and turns away from the walls
+// it runs into. The state is kept as one array per field, so a step streams
+// through memory and the instance data for drawing is a plain gather. Every
+// agent has its own random state, so a seed gives the same crowd whatever
+// the number of threads stepping it.
+class AgentSwarm {
+  double radius_, y_, speed_, turnRate_;
+  std::vector<double> x_, z_;         // position
+  std::vector<double> heading_;       // radians, walking along (cos, 0, sin)
+  std::vector<double> vx_, vz_;       // velocity over the last step, after the walls
+  std::vector<unsigned> random_;      // xorshift32 state
+
+  static double uniform(unsigned& s) {
+    s ^= s << 13;
+    s ^= s >> 17;
+    s ^= s << 5;
+    return s * (1.0 / 4294967296.0);
+  }
+
+public:
+  // turnRate: the largest drift of the heading, in radians per second
+  AgentSwarm(double radius, double y, double speed, double turnRate)
+    : radius_(radius), y_(y), speed_(speed), turnRate_(turnRate) {}
+
+  int size() const {
+    return static_cast<int>(x_.size());
+  }
+
+  double radius() const {
+    return radius_;
+  }
+
+  double y() const {
+    return y_;
+  }
+
+  double x(int i) const {
+    return x_[i];
+  }
+
+  double z(int i) const {
+    return z_[i];
+  }
+
+  double heading(int i) const {
+    return heading_[i];
+  }
+
+  Cvec3 velocity(int i) const {
+    return Cvec3(vx_[i], 0, vz_[i]);
+  }
+
+  // Replaces the agents by n new ones scattered over the xz footprint of
+  // area, away from the walls where a few tries find room
+  void spawn(int n, const Aabb& area, const WallSet& walls, unsigned long long seed) {
+    assert(n >= 0 && !area.isEmpty());
+    x_.resize(n);
+    z_.resize(n);
+    heading_.resize(n);
+    vx_.assign(n, 0);
+    vz_.assign(n, 0);
+    random_.resize(n);
+
+    MazeRandom random(seed);
+    for (int i = 0; i < n; ++i) {
+      random_[i] = static_cast<unsigned>(random.next() >> 32) | 1;   // xorshift32 must not start at 0
+      for (int attempt = 0; attempt < 16; ++attempt) {
+        x_[i] = area.lo[0] + (area.hi[0] - area.lo[0]) * uniform(random_[i]);
+        z_[i] = area.lo[2] + (area.hi[2] - area.lo[2]) * uniform(random_[i]);
+        if (!walls.touches(Cvec3(x_[i], y_, z_[i]), radius_))
+          break;
+      }
+      heading_[i] = 2 * CS175_PI * uniform(random_[i]);
+    }
+  }
+
+  // Advances every agent by dt seconds, sliding along the walls
+  void step(double dt, const WallSet& walls, JobSystem& jobs) {
+    PROFILE_SCOPE("AgentSwarm::step");
+    if (dt <= 0)
+      return;
+    jobs.parallelFor(size(), 256, [this, dt, &walls](int begin, int end) {
+      PROFILE_SCOPE("AgentSwarm::step chunk");
+      // the moves of the chunk go to the walls as one batch
+      static thread_local std::vector<SphereMove> moves;
+      static thread_local std::vector<Cvec3> reached;
+      moves.resize(end - begin);
+      reached.resize(end - begin);
+      for (int i = begin; i < end; ++i) {
+        heading_[i] += (2 * uniform(random_[i]) - 1) * turnRate_ * dt;
+        SphereMove& m = moves[i - begin];
+        m.from = Cvec3(x_[i], y_, z_[i]);
+        m.delta = Cvec3(std::cos(heading_[i]), 0, std::sin(heading_[i])) * (speed_ * dt);
+        m.radius = radius_;
+      }
+      walls.move(&moves[0], end - begin, &reached[0]);
+
+      for (int i = begin; i < end; ++i) {
+        const SphereMove& m = moves[i - begin];
+        const Cvec3 moved = reached[i - begin] - m.from;
+
+        // blocked for more than half the step: turn away, a quarter to three
+        // quarters of a turn
+        if (dot(moved, m.delta) < 0.5 * dot(m.delta, m.delta))
+          heading_[i] += CS175_PI * (0.5 + uniform(random_[i]));
+        heading_[i] = std::fmod(heading_[i], 2 * CS175_PI);
+
+        x_[i] += moved[0];
+        z_[i] += moved[2];
+        vx_[i] = moved[0] / dt;
+        vz_[i] = moved[2] / dt;
+      }
+    });
+  }
+};
+
+#endif
@@ -5,6 +5,12 @@
 #include <string>
 #include <memory>
 #include <stdexcept>
+#include <cstring>
+#include <cstdio>
+#include <cstdarg>
+#include <algorithm>
+#include <limits>
+#include <chrono>
 #if __GNUG__
 #   include <tr1/memory>
 #endif
@@ -19,8 +25,27 @@
 #include "cvec.h"
 #include "matrix4.h"
 #include "geometrymaker.h"
+#include "bounds.h"
+#include "portal.h"
+#include "lod.h"
+#include "meshopt.h"
+#include "quantize.h"
+#include "meshsoa.h"
 #include "ppm.h"
+#include "scenefile.h"
+#include "meshimport.h"
+#include "worldstream.h"
+#include "maze.h"
+#include "collision.h"
+#include "agents.h"
 #include "glsupport2.h"
+#include "frameloop.h"
+#include "profiler.h"
+#include "gpuprofiler.h"
+#include "hud.h"
+#ifndef NOMINMAX
+#define NOMINMAX    // keep min and max out of Windows.h, for std::numeric_limits<T>::max()
+#endif
 #include <Windows.h>
 
 using namespace std;      // for string, vector, iostream, and other standard C++ stuff
@@ -44,8 +69,10 @@ static int g_mouseClickX, g_mouseClickY; // coordinates for mouse click event
 static int g_activeShader = 0;
 
 static bool g_reverseDirection = false; // ī޶    ÷
-static double g_pitch = 0.0; //  ȸ 
-static double g_yaw = 0.0;   // ¿ ȸ 
+
+// Input recorded by the GLUT callbacks and consumed by the next tick
+static bool g_keyDown[256];                 // movement keys held
+static double g_mouseDx = 0, g_mouseDy = 0; // pixels moved since the last tick, y up
 
 
 struct ShaderState {
@@ -57,6 +84,7 @@ struct ShaderState {
     GLint h_uModelViewMatrix;
     GLint h_uNormalMatrix;
     GLint h_uColor;
+    GLint h_uPosScale, h_uPosBias;
 
     // Handles to vertex attributes
     GLint h_aPosition;
@@ -74,6 +102,8 @@ struct ShaderState {
         h_uModelViewMatrix = safe_glGetUniformLocation(h, "uModelViewMatrix");
         h_uNormalMatrix = safe_glGetUniformLocation(h, "uNormalMatrix");
         h_uColor = safe_glGetUniformLocation(h, "uColor");
+        h_uPosScale = safe_glGetUniformLocation(h, "uPosScale");
+        h_uPosBias = safe_glGetUniformLocation(h, "uPosBias");
 
         // Retrieve handles to vertex attributes
         h_aPosition = safe_glGetAttribLocation(h, "aPosition");
@@ -95,12 +125,90 @@ static const char* const g_shaderFilesGl2[g_numShaders][2] = {
   {"./shaders/basic-gl2.vshader", "./shaders/diffuse-gl2.fshader"},
   {"./shaders/basic-gl2.vshader", "./shaders/solid-gl2.fshader"}
 };
-static vector<shared_ptr<ShaderState> > g_shaderStates; // our global shader states
+static vector<ShaderState> g_shaderStates; // our global shader states
+
+// Shader state of the batched static scene, whose vertex shader fetches the
+// object transform of every draw from a texture buffer
+struct SceneShaderState : ShaderState {
+    GLint h_uViewMatrix;
+    GLint h_uDrawTransforms;
+    GLint h_aTexCoord;
+    GLint h_aDrawId;
+
+    SceneShaderState(const char* vsfn, const char* fsfn) : ShaderState(vsfn, fsfn) {
+        const GLuint h = program; // short hand
+
+        h_uViewMatrix = safe_glGetUniformLocation(h, "uViewMatrix");
+        h_uDrawTransforms = safe_glGetUniformLocation(h, "uDrawTransforms");
+        h_aTexCoord = safe_glGetAttribLocation(h, "aTexCoord");
+        h_aDrawId = safe_glGetAttribLocation(h, "aDrawId");
+        checkGlErrors();
+    }
+};
+
+static const char* const g_sceneShaderFiles[g_numShaders][2] = {
+  {"./shaders/scene-gl3.vshader", "./shaders/diffuse-gl3.fshader"},
+  {"./shaders/scene-gl3.vshader", "./shaders/solid-gl3.fshader"}
+};
+static vector<SceneShaderState> g_sceneShaderStates; // empty when static batching is unsupported
+
+// Shader state of the agents, drawn instanced with the position and heading
+// of every agent in a per-instance attribute
+struct AgentShaderState : ShaderState {
+    GLint h_uViewMatrix;
+    GLint h_uAgentScale;
+    GLint h_aTexCoord;
+    GLint h_aInstance;
+
+    AgentShaderState(const char* vsfn, const char* fsfn) : ShaderState(vsfn, fsfn) {
+        const GLuint h = program; // short hand
+
+        h_uViewMatrix = safe_glGetUniformLocation(h, "uViewMatrix");
+        h_uAgentScale = safe_glGetUniformLocation(h, "uAgentScale");
+        h_aTexCoord = safe_glGetAttribLocation(h, "aTexCoord");
+        h_aInstance = safe_glGetAttribLocation(h, "aInstance");
+        checkGlErrors();
+    }
+};
+
+static const char* const g_agentShaderFiles[g_numShaders][2] = {
+  {"./shaders/agent-gl3.vshader", "./shaders/diffuse-gl3.fshader"},
+  {"./shaders/agent-gl3.vshader", "./shaders/solid-gl3.fshader"}
+};
+static vector<AgentShaderState> g_agentShaderStates; // empty when instancing is unsupported
 
 GLuint wallTextureID;
 
+// --------- Frame statistics
+
+// What the draws of a frame submitted, shown by the HUD
+struct RenderStats {
+    int drawCalls;
+    long long triangles;    // strips and fans counted as if no restart broke them
+    size_t uploadBytes;     // streamed instances and indirect commands
+
+    RenderStats() : drawCalls(0), triangles(0), uploadBytes(0) {}
+
+    void addDraw(GLenum mode, long long vertices, long long instances = 1) {
+        ++drawCalls;
+        if (mode == GL_TRIANGLES)
+            triangles += instances * (vertices / 3);
+        else if (mode == GL_TRIANGLE_STRIP || mode == GL_TRIANGLE_FAN)
+            triangles += instances * max(vertices - 2, 0LL);
+    }
+};
+
+static RenderStats g_renderStats;   // of the frame being drawn, complete when the HUD draws
+static GlStateCache g_glState;      // program and vertex array binds of the frame
+
 // --------- Geometry
 
+// Pools recycling the GL names of geometries that are created and destroyed
+// often (e.g., the ground of the streamed world tiles), so they do not cost a
+// glGen*/glDelete* each
+static GlNamePool g_bufferPool(GL_NAME_BUFFER);
+static GlNamePool g_vertexArrayPool(GL_NAME_VERTEX_ARRAY);
+
 // Macro used to obtain relative offset of a field within a struct
 #define FIELD_OFFSET(StructType, field) &(((StructType *)0)->field)
 
@@ -127,72 +235,448 @@ struct VertexPNT {
     }
 };
 
+// Compact vertex: position as normalized shorts relative to the box of its
+// mesh, normal as GL_INT_2_10_10_10_REV and half float texture coordinates.
+// 16 bytes instead of the 32 of VertexPNT.
+struct VertexPNTPacked {
+    GLshort p[4];    // xyz, w is padding
+    GLuint n;
+    GLhalf t[2];
+};
+
+static vector<VertexPNTPacked> packVertices(const VertexPNT* vtx, int n, const PositionQuantization& q) {
+    vector<VertexPNTPacked> packed(n);
+    for (int i = 0; i < n; ++i) {
+        q.pack(vtx[i].p, packed[i].p);
+        packed[i].p[3] = 0;
+        packed[i].n = packSnorm1010102(vtx[i].n);
+        packed[i].t[0] = packHalf(vtx[i].t[0]);
+        packed[i].t[1] = packHalf(vtx[i].t[1]);
+    }
+    return packed;
+}
+
+static vector<VertexPNT> unpackVertices(const VertexPNTPacked* packed, int n, const PositionQuantization& q) {
+    vector<VertexPNT> vtx(n);
+    for (int i = 0; i < n; ++i) {
+        vtx[i].p = q.unpack(packed[i].p);
+        vtx[i].n = unpackSnorm1010102(packed[i].n);
+        vtx[i].t = Cvec2f(unpackHalf(packed[i].t[0]), unpackHalf(packed[i].t[1]));
+    }
+    return vtx;
+}
+
+// Whether static geometry is uploaded as VertexPNTPacked. Needs half float and
+// 2_10_10_10 vertex attributes, and the dequantisation in the GL3 shaders.
+static bool g_packedVertices = false;
+
+static bool packedVerticesSupported() {
+    return !g_Gl2Compatible && (GLEW_VERSION_3_3 || GLEW_ARB_vertex_type_2_10_10_10_rev);
+}
+
+// Points the position, normal and texture coordinate attributes at the
+// vertex buffer bound to GL_ARRAY_BUFFER, holding VertexPNTPacked if packed
+// and VertexPNT otherwise
+static void setVertexAttribPointers(GLint h_aPosition, GLint h_aNormal, GLint h_aTexCoord, bool packed) {
+    if (packed) {
+        safe_glVertexAttribPointer(h_aPosition, 3, GL_SHORT, GL_TRUE, sizeof(VertexPNTPacked), FIELD_OFFSET(VertexPNTPacked, p));
+        safe_glVertexAttribPointer(h_aNormal, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(VertexPNTPacked), FIELD_OFFSET(VertexPNTPacked, n));
+        safe_glVertexAttribPointer(h_aTexCoord, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(VertexPNTPacked), FIELD_OFFSET(VertexPNTPacked, t));
+    }
+    else {
+        safe_glVertexAttribPointer(h_aPosition, 3, GL_FLOAT, GL_FALSE, sizeof(VertexPNT), FIELD_OFFSET(VertexPNT, p));
+        safe_glVertexAttribPointer(h_aNormal, 3, GL_FLOAT, GL_FALSE, sizeof(VertexPNT), FIELD_OFFSET(VertexPNT, n));
+        safe_glVertexAttribPointer(h_aTexCoord, 2, GL_FLOAT, GL_FALSE, sizeof(VertexPNT), FIELD_OFFSET(VertexPNT, t));
+    }
+}
+
+// Sends the dequantisation of packed positions, the identity for floats
+static void sendPositionQuantization(const ShaderState& curSS, const PositionQuantization& q) {
+    safe_glUniform3f(curSS.h_uPosScale, q.scale[0], q.scale[1], q.scale[2]);
+    safe_glUniform3f(curSS.h_uPosBias, q.bias[0], q.bias[1], q.bias[2]);
+}
+
 struct Geometry {
 
     GlVertexArrayObject vao;
     GlBufferObject vbo, ibo;
     int vboLen, iboLen;
-
+    GLenum mode;                        // GL_TRIANGLES, or a strip/fan type
+    GLenum indexType;                   // narrowest type for vboLen vertices
+    bool primitiveRestart;              // whether the indices contain restarts
+    bool packed;                        // VertexPNTPacked instead of VertexPNT
+    PositionQuantization quantization;  // of the packed positions
+
+    // Indices may be of any unsigned integer type. The largest value of the
+    // type marks a primitive restart, e.g., between the strips of a mesh.
     // : VertexPNT ϴ  ߰
-    template <typename VertexType>
-    Geometry(VertexType* vtx, unsigned short* idx, int vboLen, int iboLen) {
-        this->vboLen = vboLen;
-        this->iboLen = iboLen;
+    template <typename VertexType, typename IndexType>
+    Geometry(VertexType* vtx, IndexType* idx, int vboLen, int iboLen, GLenum mode = GL_TRIANGLES)
+        : vao(g_vertexArrayPool), vbo(g_bufferPool), ibo(g_bufferPool), mode(mode), packed(false) {
+        upload(vtx, sizeof(VertexType) * vboLen, idx, vboLen, iboLen);
+    }
 
+    // Uploads a triangle list as it is, without looking at it, e.g., straight
+    // from a mapped scene file: VertexPNTPacked dequantised by q if packed,
+    // VertexPNT otherwise, and indices of indexType
+    Geometry(const void* vtx, int vboLen, bool packed, const PositionQuantization& q,
+             const void* idx, int iboLen, GLenum indexType)
+        : vao(g_vertexArrayPool), vbo(g_bufferPool), ibo(g_bufferPool), vboLen(vboLen), iboLen(iboLen),
+          mode(GL_TRIANGLES), indexType(indexType), primitiveRestart(false), packed(packed), quantization(q) {
         glBindVertexArray(vao);
 
         glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(VertexType) * vboLen, vtx, GL_STATIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, (packed ? sizeof(VertexPNTPacked) : sizeof(VertexPNT)) * vboLen, vtx, GL_STATIC_DRAW);
 
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned short) * iboLen, idx, GL_STATIC_DRAW);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLsizeiptr>(indexSize(indexType)) * iboLen, idx, GL_STATIC_DRAW);
+    }
+
+    template <typename IndexType>
+    Geometry(VertexPNTPacked* vtx, IndexType* idx, int vboLen, int iboLen, const PositionQuantization& q,
+             GLenum mode = GL_TRIANGLES)
+        : vao(g_vertexArrayPool), vbo(g_bufferPool), ibo(g_bufferPool), mode(mode), packed(true), quantization(q) {
+        upload(vtx, sizeof(VertexPNTPacked) * vboLen, idx, vboLen, iboLen);
     }
 
     void draw(const ShaderState& curSS) {
-        glBindVertexArray(vao);
+        g_glState.bindVertexArray(vao);
         safe_glEnableVertexAttribArray(curSS.h_aPosition);
         safe_glEnableVertexAttribArray(curSS.h_aNormal);
 
         GLint h_aTexCoord = safe_glGetAttribLocation(curSS.program, "aTexCoord");
+        if (h_aTexCoord != -1) // ؽó ǥ ִ 
+            safe_glEnableVertexAttribArray(h_aTexCoord);
 
         glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        safe_glVertexAttribPointer(curSS.h_aPosition, 3, GL_FLOAT, GL_FALSE, sizeof(VertexPNT), FIELD_OFFSET(VertexPNT, p));
-        safe_glVertexAttribPointer(curSS.h_aNormal, 3, GL_FLOAT, GL_FALSE, sizeof(VertexPNT), FIELD_OFFSET(VertexPNT, n));
-
-        if (h_aTexCoord != -1) { // ؽó ǥ ִ 
-            safe_glEnableVertexAttribArray(h_aTexCoord);
-            safe_glVertexAttribPointer(h_aTexCoord, 2, GL_FLOAT, GL_FALSE, sizeof(VertexPNT), FIELD_OFFSET(VertexPNT, t));
-        }
+        setVertexAttribPointers(curSS.h_aPosition, curSS.h_aNormal, h_aTexCoord, packed);
+        sendPositionQuantization(curSS, quantization);
 
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
-        glDrawElements(GL_TRIANGLES, iboLen, GL_UNSIGNED_SHORT, 0);
+        if (primitiveRestart) {
+            glEnable(GL_PRIMITIVE_RESTART);
+            glPrimitiveRestartIndex(restartIndexFor(indexType));
+        }
+        glDrawElements(mode, iboLen, indexType, 0);
+        g_renderStats.addDraw(mode, iboLen);
+        if (primitiveRestart)
+            glDisable(GL_PRIMITIVE_RESTART);
 
         safe_glDisableVertexAttribArray(curSS.h_aPosition);
         safe_glDisableVertexAttribArray(curSS.h_aNormal);
         if (h_aTexCoord != -1) safe_glDisableVertexAttribArray(h_aTexCoord);
     }
+
+private:
+    template <typename IndexType>
+    void upload(const void* vtx, GLsizeiptr vtxSize, const IndexType* idx, int vboLen, int iboLen) {
+        this->vboLen = vboLen;
+        this->iboLen = iboLen;
+
+        // widen to 32 bits, then narrow to what vboLen needs
+        const IndexType restart = std::numeric_limits<IndexType>::max();
+        vector<unsigned> wide(iboLen);
+        primitiveRestart = false;
+        for (int i = 0; i < iboLen; ++i) {
+            if (idx[i] == restart) {
+                wide[i] = PRIMITIVE_RESTART;
+                primitiveRestart = true;
+            }
+            else {
+                wide[i] = idx[i];
+            }
+        }
+        if (primitiveRestart && !GLEW_VERSION_3_1)
+            throw runtime_error("Primitive restart requires OpenGL 3.1");
+        indexType = indexTypeFor(vboLen);
+        const vector<unsigned char> packedIdx = packIndices(&wide[0], wide.size(), indexType);
+
+        glBindVertexArray(vao);
+
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, vtxSize, vtx, GL_STATIC_DRAW);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, packedIdx.size(), &packedIdx[0], GL_STATIC_DRAW);
+    }
+};
+
+
+// CPU-side copy of a static mesh, kept so that all static meshes can be packed
+// together into the arenas of the StaticSceneBatch. A mesh loaded from a scene
+// file is not copied: it is mesh fileMesh of the mapped file, whose blobs are
+// already in the layout uploaded, and vtx and idx stay empty.
+struct MeshData {
+    vector<VertexPNT> vtx;
+    vector<unsigned> idx;   // narrowed when uploaded
+    Aabb packBox;   // positions are packed relative to it, bounds() if empty
+    const SceneFile* file;
+    int fileMesh;
+
+    MeshData() : file(NULL), fileMesh(0) {}
+
+    // The vertices and indices of a mesh built in memory
+    const VertexPNT* vertices() const {
+        assert(!file);
+        return vtx.empty() ? NULL : &vtx[0];
+    }
+
+    const unsigned* indices() const {
+        assert(!file);
+        return idx.empty() ? NULL : &idx[0];
+    }
+
+    int numVertices() const {
+        return file ? static_cast<int>(file->mesh(fileMesh).numVertices) : static_cast<int>(vtx.size());
+    }
+
+    int numIndices() const {
+        return file ? static_cast<int>(file->mesh(fileMesh).numIndices) : static_cast<int>(idx.size());
+    }
+
+    // The levels of a LodChain share one box, so that one dequantisation
+    // applies to all of them
+    PositionQuantization quantization() const {
+        const Aabb box = packBox.isEmpty() ? bounds() : packBox;
+        return PositionQuantization(box.lo, box.hi);
+    }
+
+    Aabb bounds() const {
+        Aabb box;
+        if (file) {
+            const SceneFileMesh& m = file->mesh(fileMesh);
+            box.add(Cvec3(m.boundsLo[0], m.boundsLo[1], m.boundsLo[2]));
+            box.add(Cvec3(m.boundsHi[0], m.boundsHi[1], m.boundsHi[2]));
+            return box;
+        }
+        for (size_t i = 0; i < vtx.size(); ++i)
+            box.add(Cvec3(vtx[i].p[0], vtx[i].p[1], vtx[i].p[2]));
+        return box;
+    }
 };
 
+// The vertices of a mesh read from a scene file in the layout uploaded:
+// VertexPNTPacked if packed, VertexPNT otherwise. That is the stored blob,
+// except for packed blobs on GL without the packed attributes, which are
+// unpacked into scratch.
+static const void* fileVertices(const MeshData& mesh, bool packed, vector<VertexPNT>& scratch) {
+    const SceneFileMesh& m = mesh.file->mesh(mesh.fileMesh);
+    const void* vtx = mesh.file->vertices(mesh.fileMesh);
+    const bool stored = m.vertexFormat == SCENE_VERTEX_PNT_PACKED;
+    assert(stored || !packed);
+    if (stored == packed || m.numVertices == 0)
+        return vtx;
+    scratch = unpackVertices(static_cast<const VertexPNTPacked*>(vtx), m.numVertices, mesh.quantization());
+    return &scratch[0];
+}
+
+// Static meshes shared by the scene nodes
+enum StaticMesh {
+    MESH_GROUND,
+    MESH_WALL_5x10,
+    MESH_WALL_5x5,
+    MESH_SPHERE,        // the levels of a LodChain follow each other, finest first
+    MESH_SPHERE_LOD1,
+    MESH_SPHERE_LOD2,
+    MESH_SPHERE_LOD3,
+    NUM_STATIC_MESHES
+};
 
-// Vertex buffer and index buffer associated with the ground and cube geometry
-static shared_ptr<Geometry> g_ground;
+// Tessellations of MESH_SPHERE .. MESH_SPHERE_LOD3
+static const int g_sphereLodSlices[] = { 48, 24, 12, 6 };
+
+// Level of detail chains by the first static mesh of the chain, by the pixels
+// a node covers. Empty for the other meshes. Sized before nodes point into it.
+static vector<LodChain> g_meshLods;
+
+// An instance of a static mesh placed in the world
+struct SceneNode {
+    int mesh;               // StaticMesh, the finest level if lods is given
+    Matrix4 rbt;            // object to world
+    const LodChain* lods;   // NULL for a single level
+    bool collider;          // a wall the eye collides with, see g_walls
+
+    SceneNode(int mesh, const Matrix4& rbt, const LodChain* lods = NULL, bool collider = false)
+        : mesh(mesh), rbt(rbt), lods(lods), collider(collider) {}
+};
+
+static vector<MeshData> g_staticMeshData;
+static shared_ptr<SceneFile> g_sceneFileData;  // mapped scene file the static meshes read, if loaded
+static vector<Geometry> g_staticMeshes;     // one Geometry per static mesh, for per-node drawing
+static vector<SceneNode> g_sceneNodes;      // ground, walls and future props
+static WallSet g_walls;                     // of the collider nodes
+static const double g_eyeRadius = 0.5;     // of the sphere around the eye that collides with the walls
+static vector<int> g_nodeLods;              // current level of every node, mesh + level is drawn
+static int g_drawnTriangles;                // of the last frame, at the selected levels
+
+// View frustum culling of the scene nodes
+static Bvh g_sceneBvh;                      // over the world boxes of g_sceneNodes
+static vector<int> g_visibleNodes;          // nodes to draw this frame, reused across frames
+static CullStats g_cullStats;               // of the last frame
+static bool g_frustumCulling = true;        // toggled with 'c'
+
+// An opening between two cells of the scene: an axis aligned rectangle, given
+// as a box that is flat along one axis
+struct ScenePortal {
+    int cells[2];
+    Aabb rect;
+
+    ScenePortal(int cellA, int cellB, const Aabb& rect) : rect(rect) {
+        cells[0] = cellA;
+        cells[1] = cellB;
+    }
+};
+
+// Cells and portals the scene declares, built in code or loaded with it. A
+// cell is a box the eye can be in, or an empty box for the outside, which is
+// only seen through portals. A scene without cells is culled by the BVH alone.
+static vector<Aabb> g_sceneCells;
+static vector<ScenePortal> g_scenePortals;
+
+// The graph of the scene's cells. While the eye is inside a cell this
+// replaces the BVH, otherwise the BVH is used.
+static CellPortalGraph g_cells;
+static Bvh g_outsideBvh;                    // over the nodes outside every cell
+static PortalStats g_portalStats;           // of the last frame
+static bool g_portalCulling = true;         // toggled with 'p'
+static bool g_eyeInCell = false;            // whether the last frame used the portals
+
+// Scene file given with --scene or --verify-scene, otherwise the scene is built in code
+static const char* g_sceneFile = NULL;
+static bool g_verifyScene = false;        // the scene was given with --verify-scene, check all its indices
+static const char* g_importFile = NULL;   // OBJ or PLY given with --import, added to the built scene
+static int g_mazeWidth = 0, g_mazeDepth = 0;  // cells of the maze given with --maze NxM, none if 0
+static unsigned long long g_mazeSeed = 1;     // --seed, the same seed always gives the same maze
+
+// A tile of the streamed world: a ground grid and corridor units. Built on the
+// streaming thread, its ground is uploaded and released on the main thread.
+struct WorldTile {
+    MeshData ground;
+    shared_ptr<Geometry> groundGeometry;
+    vector<SceneNode> walls;        // of the static wall meshes
+    vector<Aabb> wallBoxes;
+    WallSet colliders;              // the walls
+    Aabb box;
+
+    size_t bytes() const {
+        return sizeof(VertexPNT) * ground.vtx.size() + sizeof(unsigned) * ground.idx.size() +
+            (sizeof(SceneNode) + 2 * sizeof(Aabb) + sizeof(WallRect)) * walls.size();
+    }
+};
+
+// Streaming of the world around the eye, enabled with --world <budget in MB>.
+// The tiles replace the single large ground quad.
+static shared_ptr<TileStreamer<WorldTile> > g_world;
+static size_t g_worldBudget = 0;                // bytes, 0 when not streaming
+static const double g_tileSize = 50.0;
+static const double g_worldRadius = 75.0;       // tiles closer than this are kept, beyond the far plane
+static const int g_tileGroundCells = 32;        // ground grid resolution per tile
+static string g_textureFile = "wall.ppm";
+
+// --------- Agents
+
+static int g_numAgents = 0;                     // --agents, none if 0
+static shared_ptr<JobSystem> g_jobs;            // steps the agents
+static shared_ptr<AgentSwarm> g_agents;
+static const double g_agentRadius = 0.3;
+static double g_agentStepMs = 0;                // wall time of the last step
 
 // --------- Scene
 
 static const Cvec3 g_light1(5.0, 5.0, 6.0), g_light2(-7.0, -2.0, -10.0);  // define two lights positions in world space
 
-static Matrix4 g_skyRbt = Matrix4::makeTranslation(Cvec3(0.0, 0.0, 3.0));
+// The eye is simulated in fixed ticks; frames are drawn from g_skyRbt,
+// interpolated between the states after the last two ticks
+struct EyeState {
+    Cvec3 position;
+    double yaw, pitch;   // degrees, ¿ /  ȸ 
 
+    EyeState(const Cvec3& position, double yaw, double pitch) : position(position), yaw(yaw), pitch(pitch) {}
+};
+
+static EyeState g_eye(Cvec3(0.0, 0.0, 3.0), 0.0, 0.0), g_prevEye = g_eye;
+static Matrix4 g_skyRbt = Matrix4::makeTranslation(g_eye.position);
+
+static const double g_tickSeconds = 1.0 / 60.0;
+static const int g_maxTicksPerFrame = 8;    // time beyond is dropped rather than caught up
+static const double g_moveSpeed = 6.0;      // units per second, what 0.2 per key repeat gave at 30 Hz
+static const double g_mouseDegreesPerPixel = 0.2;
+static double g_tickAccumulator = 0;        // simulated time owed, less than a tick after every frame
+static chrono::steady_clock::time_point g_lastFrameTime;
+static bool g_firstFrame = true;
+
+static FrameLoop g_frameLoop;
+static FramePacing g_pacing = PACING_VSYNC;   // --pacing vsync, benchmark or a rate in Hz
+static double g_pacingRate = 30.0;
+static const char* g_traceFile = "trace.json"; // --trace, written on exit when built with ENABLE_PROFILER
+static shared_ptr<GpuProfiler> g_gpuProfiler;   // times the render passes on the GPU
+
+// Performance overlay drawn over every frame
+static const char* const g_hudShaderFiles[2] = { "./shaders/hud-gl3.vshader", "./shaders/hud-gl3.fshader" };
+static shared_ptr<Hud> g_hud;                   // NULL when unsupported
+static bool g_showHud = true;                   // toggled with 'v'
+static const int g_hudGraphFrames = 128;        // frames in the time graphs
+static float g_cpuMsHistory[g_hudGraphFrames], g_gpuMsHistory[g_hudGraphFrames];
+static long long g_hudFrames = 0;               // frames put into the histories
+
+
+// Reorders the triangles of mesh for the post-transform vertex cache, then
+// for overdraw, and its vertices in fetch order. Prints the cache miss
+// ratios before and after.
+static void optimizeMesh(MeshData& mesh, const char* name) {
+    if (mesh.idx.empty())
+        return;
+    unsigned* idx = &mesh.idx[0];
+    const size_t numIndices = mesh.idx.size();
+    const VertexCacheStats before = analyzeVertexCache(idx, numIndices, mesh.vtx.size());
+
+    optimizeVertexCache(idx, numIndices, mesh.vtx.size());
+    const vector<VertexPNT>& vtx = mesh.vtx;
+    optimizeOverdraw(idx, numIndices, vtx.size(),
+        [&vtx](int v) { return Cvec3(vtx[v].p[0], vtx[v].p[1], vtx[v].p[2]); });
+    optimizeVertexFetch(mesh.vtx, idx, numIndices);
+
+    const VertexCacheStats after = analyzeVertexCache(idx, numIndices, mesh.vtx.size());
+    cout << name << ": ACMR " << before.acmr << " -> " << after.acmr
+        << ", ATVR " << before.atvr << " -> " << after.atvr << endl;
+}
 
-static void initGround() {
+// The attributes of interleaved VertexPNT, for the generators and MeshSoA
+static VertexSpan vertexSpan(vector<VertexPNT>& vtx) {
+    VertexSpan span;
+    span.pos = &vtx[0].p[0];
+    span.normal = &vtx[0].n[0];
+    span.tex = &vtx[0].t[0];
+    span.posStride = span.normalStride = span.texStride = sizeof(VertexPNT) / sizeof(float);
+    return span;
+}
+
+static MeshData createSphere(float radius, int slices) {
+    int vbLen, ibLen;
+    getSphereVbIbLen(slices, slices / 2, vbLen, ibLen);
+
+    MeshData mesh;
+    mesh.vtx.resize(vbLen);
+    mesh.idx.resize(ibLen);
+
+    // generated in place, straight into the interleaved vertices
+    makeSphere(radius, slices, slices / 2, vertexSpan(mesh.vtx), &mesh.idx[0]);
+    return mesh;
+}
+
+static MeshData createGround() {
     VertexPNT vtx[4] = {
         VertexPNT(-g_groundSize, g_groundY, -g_groundSize, 0, 1, 0, 0, 0),
         VertexPNT(-g_groundSize, g_groundY,  g_groundSize, 0, 1, 0, 0, 1),
         VertexPNT(g_groundSize, g_groundY,  g_groundSize, 0, 1, 0, 1, 1),
         VertexPNT(g_groundSize, g_groundY, -g_groundSize, 0, 1, 0, 1, 0),
     };
-    unsigned short idx[] = { 0, 1, 2, 0, 2, 3 };
-    g_ground.reset(new Geometry(&vtx[0], &idx[0], 4, 6));
+    unsigned idx[] = { 0, 1, 2, 0, 2, 3 };
+
+    MeshData mesh;
+    mesh.vtx.assign(vtx, vtx + 4);
+    mesh.idx.assign(idx, idx + 6);
+    return mesh;
 }
 
 // takes a projection matrix and send to the the shaders
@@ -286,7 +770,7 @@ static void loadTexture(const char* filename, GLuint& textureID) {
 }
 
 
-static shared_ptr<Geometry> createTexturedPlane(float width, float height) {
+static MeshData createTexturedPlane(float width, float height) {
     VertexPNT vtx[4] = {
         VertexPNT(-width / 2, 0.0, -height / 2, 0, 1, 0, 0, 0),   //  Ʒ
         VertexPNT(width / 2, 0.0, -height / 2, 0, 1, 0, 1, 0),    //  Ʒ
@@ -294,28 +778,35 @@ static shared_ptr<Geometry> createTexturedPlane(float width, float height) {
         VertexPNT(-width / 2, 0.0, height / 2, 0, 1, 0, 0, 1),    //  
     };
 
-    unsigned short idx[] = { 0, 1, 2, 0, 2, 3 };
+    unsigned idx[] = { 0, 1, 2, 0, 2, 3 };
 
-    return make_shared<Geometry>(&vtx[0], &idx[0], 4, 6);
+    MeshData mesh;
+    mesh.vtx.assign(vtx, vtx + 4);
+    mesh.idx.assign(idx, idx + 6);
+    return mesh;
 }
 
 
-static void drawPlane(const ShaderState& curSS, shared_ptr<Geometry> plane, const Matrix4& transform) {
-    glActiveTexture(GL_TEXTURE0); // ؽó  0 Ȱȭ
-    glBindTexture(GL_TEXTURE_2D, wallTextureID); // ؽó ε
-
-    GLint uTextureLoc = safe_glGetUniformLocation(curSS.program, "uTexture");
-    if (uTextureLoc != -1) {
-        glUniform1i(uTextureLoc, 0); // uTexture  ؽó  0 
+// Draws the given scene nodes, each with its own glDrawElements. When
+// conditions is given, a node with a nonzero query in it is drawn under
+// conditional rendering on that query.
+static void drawSceneNodes(const ShaderState& curSS, const Matrix4& invEyeRbt, const vector<int>& nodes,
+                           const vector<GLuint>* conditions = NULL) {
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        const SceneNode& node = g_sceneNodes[nodes[i]];
+        const GLuint query = conditions ? (*conditions)[nodes[i]] : 0;
+
+        // MVM 
+        Matrix4 MVM = invEyeRbt * node.rbt;
+        Matrix4 NMVM = normalMatrix(MVM);
+        sendModelViewNormalMatrix(curSS, MVM, NMVM);
+
+        if (query)
+            glBeginConditionalRender(query, GL_QUERY_NO_WAIT);
+        g_staticMeshes[node.mesh + g_nodeLods[nodes[i]]].draw(curSS);
+        if (query)
+            glEndConditionalRender();
     }
-
-    // MVM 
-    Matrix4 MVM = inv(g_skyRbt) * transform;
-    Matrix4 NMVM = normalMatrix(MVM);
-    sendModelViewNormalMatrix(curSS, MVM, NMVM);
-
-    // ÷ ׸
-    plane->draw(curSS);
 }
 
 
@@ -339,54 +830,727 @@ static void drawPlane(const ShaderState& curSS, shared_ptr<Geometry> plane, cons
 //}
 
 
-void createStructure(const ShaderState& curSS, const Matrix4& transform, vector<Matrix4>& planeTransforms) {
+// Adds the three walls of a corridor unit placed by transform to the scene
+void createStructure(const Matrix4& transform, vector<SceneNode>& nodes) {
+    PROFILE_SCOPE("createStructure");
     // wall_1
-    auto leftPlane = createTexturedPlane(5.0, 10.0);
     Matrix4 leftTransform = transform * Matrix4::makeTranslation(Cvec3(-2.5, 0.5, -7.5)) * Matrix4::makeZRotation(-90);
-    drawPlane(curSS, leftPlane, leftTransform);
-    planeTransforms.push_back(leftTransform);
+    nodes.push_back(SceneNode(MESH_WALL_5x10, leftTransform, NULL, true));
 
     // wall_2
-    auto facePlane = createTexturedPlane(5.0, 5.0);
     Matrix4 faceTransform = transform * Matrix4::makeTranslation(Cvec3(0.0, 0.5, -12.5)) * Matrix4::makeXRotation(90);
-    drawPlane(curSS, facePlane, faceTransform);
-    planeTransforms.push_back(faceTransform);
+    nodes.push_back(SceneNode(MESH_WALL_5x5, faceTransform, NULL, true));
 
     // wall_3
-    auto rightPlane = createTexturedPlane(5.0, 10.0);
     Matrix4 rightTransform = transform * Matrix4::makeTranslation(Cvec3(2.5, 0.5, -7.5)) * Matrix4::makeZRotation(90);
-    drawPlane(curSS, rightPlane, rightTransform);
-    planeTransforms.push_back(rightTransform);
+    nodes.push_back(SceneNode(MESH_WALL_5x10, rightTransform, NULL, true));
+}
+
+
+// Adds an n x m maze built from the wall meshes, its cells as wide as the
+// corridor units, south of the entrance corridor and entered from it through
+// cell (n / 2, 0). Straight runs of two cells use the 5x10 wall.
+void createMaze(int n, int m, unsigned long long seed, vector<SceneNode>& nodes) {
+    const double cell = 5.0, x0 = -2.5 - cell * (n / 2), z0 = 15.0;
+    const vector<MazeWall> walls = makeMaze(n, m, seed, n / 2);
+    for (size_t i = 0; i < walls.size(); ++i) {
+        const MazeWall& w = walls[i];
+        const double half = 0.5 * cell * w.length;
+        const Matrix4 rbt = w.alongX ?
+            Matrix4::makeTranslation(Cvec3(x0 + cell * w.x + half, 0.5, z0 + cell * w.z)) * Matrix4::makeYRotation(90) * Matrix4::makeZRotation(90) :
+            Matrix4::makeTranslation(Cvec3(x0 + cell * w.x, 0.5, z0 + cell * w.z + half)) * Matrix4::makeZRotation(90);
+        nodes.push_back(SceneNode(w.length == 2 ? MESH_WALL_5x10 : MESH_WALL_5x5, rbt, NULL, true));
+    }
+    cout << "Maze: " << n << " x " << m << " cells, " << walls.size() << " walls" << endl;
+}
+
+
+// --------- Static scene batching
+
+// One record of the indirect draw buffer, as read by glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+// All static meshes packed into one vertex arena and one index arena, with the
+// transforms of every scene node in a texture buffer, so the whole static scene
+// is submitted with one glMultiDrawElementsIndirect no matter how many nodes it
+// has. The node index reaches the vertex shader through an instanced aDrawId
+// attribute and the baseInstance of each command. Without multi-draw indirect
+// the same arenas are drawn with one glDrawElementsBaseVertex per node.
+struct StaticSceneBatch {
+
+    GlVertexArrayObject vao;
+    GlBufferObject vbo, ibo, drawIdVbo, transformBo;
+    shared_ptr<StreamBuffer> commands;                  // ring of the frameCommands, NULL without multiDrawIndirect
+    GlTexture transformTex;
+    vector<DrawElementsIndirectCommand> meshCommands;   // one per static mesh, drawing it whole
+    vector<int> nodeMeshes;                             // static mesh of every scene node
+    vector<DrawElementsIndirectCommand> frameCommands;  // the visible nodes, rebuilt every frame
+    bool multiDrawIndirect;
+    bool packed;                                        // VertexPNTPacked arena, dequantised by the node transforms
+    GLenum indexType;                                   // narrowest type for the largest mesh
+
+    static const int TEXELS_PER_DRAW = 8; // model matrix, then normal matrix, as RGBA32F columns
+
+    StaticSceneBatch(const vector<MeshData>& meshes, const vector<SceneNode>& nodes, bool packed)
+        : packed(packed) {
+        // the draw id attribute uses the core glVertexAttribDivisor of GL 3.3
+        multiDrawIndirect = GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance && GLEW_VERSION_3_3;
+        // the occluders are drawn twice a frame, every other node at most once
+        if (multiDrawIndirect)
+            commands.reset(new StreamBuffer(GL_DRAW_INDIRECT_BUFFER,
+                sizeof(DrawElementsIndirectCommand) * 2 * max(nodes.size(), static_cast<size_t>(1))));
+
+        // Lay the meshes out in the arenas, indices stay relative to their mesh
+        int numVertices = 0, numIndices = 0, maxMeshVertices = 0;
+        for (size_t i = 0; i < meshes.size(); ++i) {
+            DrawElementsIndirectCommand cmd;
+            cmd.count = static_cast<GLuint>(meshes[i].numIndices());
+            cmd.instanceCount = 1;
+            cmd.firstIndex = static_cast<GLuint>(numIndices);
+            cmd.baseVertex = static_cast<GLint>(numVertices);
+            cmd.baseInstance = 0;
+            meshCommands.push_back(cmd);
+            numVertices += meshes[i].numVertices();
+            numIndices += meshes[i].numIndices();
+            maxMeshVertices = max(maxMeshVertices, meshes[i].numVertices());
+        }
+
+        // One pair of matrices per node
+        vector<GLint> drawIds(nodes.size());
+        vector<GLfloat> transforms(nodes.size() * TEXELS_PER_DRAW * 4);
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            nodeMeshes.push_back(nodes[i].mesh);
+            drawIds[i] = static_cast<GLint>(i);
+
+            // packed positions are dequantised as part of the model matrix
+            Matrix4 model = nodes[i].rbt;
+            if (packed) {
+                const PositionQuantization q = meshes[nodes[i].mesh].quantization();
+                model = model * Matrix4::makeTranslation(Cvec3(q.bias[0], q.bias[1], q.bias[2])) *
+                    Matrix4::makeScale(Cvec3(q.scale[0], q.scale[1], q.scale[2]));
+            }
+            model.writeToColumnMajorMatrix(&transforms[i * TEXELS_PER_DRAW * 4]);
+            normalMatrix(nodes[i].rbt).writeToColumnMajorMatrix(&transforms[i * TEXELS_PER_DRAW * 4 + 16]);
+        }
+
+        glBindVertexArray(vao);
+
+        // and fill them mesh by mesh. Meshes read in place from a scene file
+        // go in as they are stored, with the index type of the file; the
+        // others are packed if asked to and their indices narrowed, the
+        // widest mesh deciding.
+        const bool asStored = !meshes.empty() && meshes[0].file;
+        for (size_t i = 0; i < meshes.size(); ++i) {
+            if ((meshes[i].file != NULL) != asStored)
+                throw runtime_error("StaticSceneBatch: meshes from a scene file and built meshes cannot be mixed");
+        }
+        const GLsizeiptr vertexSize = packed ? sizeof(VertexPNTPacked) : sizeof(VertexPNT);
+        indexType = asStored ? static_cast<GLenum>(meshes[0].file->mesh(meshes[0].fileMesh).indexType) :
+            indexTypeFor(maxMeshVertices);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, vertexSize * numVertices, NULL, GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLsizeiptr>(indexSize(indexType)) * numIndices, NULL, GL_STATIC_DRAW);
+        for (size_t i = 0; i < meshes.size(); ++i) {
+            const MeshData& mesh = meshes[i];
+            const DrawElementsIndirectCommand& cmd = meshCommands[i];
+            if (mesh.numIndices() == 0)
+                continue;
+            const GLintptr indexOffset = static_cast<GLintptr>(indexSize(indexType)) * cmd.firstIndex;
+            if (mesh.file) {
+                vector<VertexPNT> unpacked;
+                glBufferSubData(GL_ARRAY_BUFFER, vertexSize * cmd.baseVertex, vertexSize * mesh.numVertices(),
+                                fileVertices(mesh, packed, unpacked));
+                glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, indexOffset, static_cast<GLsizeiptr>(indexSize(indexType)) * cmd.count,
+                                mesh.file->indices(mesh.fileMesh));
+                continue;
+            }
+            if (packed) {
+                const vector<VertexPNTPacked> p = packVertices(mesh.vertices(), mesh.numVertices(), mesh.quantization());
+                glBufferSubData(GL_ARRAY_BUFFER, vertexSize * cmd.baseVertex, vertexSize * p.size(), &p[0]);
+            }
+            else {
+                glBufferSubData(GL_ARRAY_BUFFER, vertexSize * cmd.baseVertex, vertexSize * mesh.numVertices(), mesh.vertices());
+            }
+            if (indexType == GL_UNSIGNED_INT) {
+                glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, indexOffset, sizeof(unsigned) * cmd.count, mesh.indices());
+            }
+            else {
+                const vector<unsigned char> packedIdx = packIndices(mesh.indices(), cmd.count, indexType);
+                glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, indexOffset, packedIdx.size(), &packedIdx[0]);
+            }
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, drawIdVbo);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(GLint) * drawIds.size(), &drawIds[0], GL_STATIC_DRAW);
+
+        glBindBuffer(GL_TEXTURE_BUFFER, transformBo);
+        glBufferData(GL_TEXTURE_BUFFER, sizeof(GLfloat) * transforms.size(), &transforms[0], GL_STATIC_DRAW);
+        glBindTexture(GL_TEXTURE_BUFFER, transformTex);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, transformBo);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+        frameCommands.reserve(nodes.size());
+        checkGlErrors();
+    }
+
+    // Bracket the draws of a frame, whose commands share one segment of the ring
+    void beginFrame() {
+        if (commands)
+            commands->beginFrame();
+    }
+
+    void endFrame() {
+        if (commands)
+            commands->endFrame();
+    }
+
+    // Draws the given scene nodes, node n with mesh level lods[n]
+    void draw(const SceneShaderState& curSS, const vector<int>& nodes, const vector<int>& lods) {
+        frameCommands.clear();
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            const int n = nodes[i];
+            DrawElementsIndirectCommand cmd = meshCommands[nodeMeshes[n] + lods[n]];
+            cmd.baseInstance = static_cast<GLuint>(n);
+            frameCommands.push_back(cmd);
+        }
+        if (frameCommands.empty())
+            return;
+
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_BUFFER, transformTex);
+        safe_glUniform1i(curSS.h_uDrawTransforms, 1);
+        glActiveTexture(GL_TEXTURE0);
+
+        g_glState.bindVertexArray(vao);
+        safe_glEnableVertexAttribArray(curSS.h_aPosition);
+        safe_glEnableVertexAttribArray(curSS.h_aNormal);
+        safe_glEnableVertexAttribArray(curSS.h_aTexCoord);
+
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        setVertexAttribPointers(curSS.h_aPosition, curSS.h_aNormal, curSS.h_aTexCoord, packed);
+
+        if (multiDrawIndirect) {
+            if (curSS.h_aDrawId >= 0) {
+                glEnableVertexAttribArray(curSS.h_aDrawId);
+                glBindBuffer(GL_ARRAY_BUFFER, drawIdVbo);
+                glVertexAttribIPointer(curSS.h_aDrawId, 1, GL_INT, 0, 0);
+                glVertexAttribDivisor(curSS.h_aDrawId, 1);
+            }
+
+            // the visible set changes every frame, so the commands are streamed
+            const GLsizeiptr size = sizeof(DrawElementsIndirectCommand) * frameCommands.size();
+            GLintptr offset;
+            memcpy(commands->allocate(size, sizeof(GLuint), offset), &frameCommands[0], size);
+            commands->flush();
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, *commands);
+            glMultiDrawElementsIndirect(GL_TRIANGLES, indexType, reinterpret_cast<GLvoid*>(offset),
+                                        static_cast<GLsizei>(frameCommands.size()), 0);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+            g_renderStats.uploadBytes += size;
+            ++g_renderStats.drawCalls;
+            for (size_t i = 0; i < frameCommands.size(); ++i)
+                g_renderStats.triangles += frameCommands[i].count / 3;
+
+            if (curSS.h_aDrawId >= 0) {
+                glVertexAttribDivisor(curSS.h_aDrawId, 0);
+                glDisableVertexAttribArray(curSS.h_aDrawId);
+            }
+        }
+        else {
+            for (size_t i = 0; i < frameCommands.size(); ++i) {
+                const DrawElementsIndirectCommand& cmd = frameCommands[i];
+                if (curSS.h_aDrawId >= 0)
+                    glVertexAttribI1i(curSS.h_aDrawId, cmd.baseInstance);
+                glDrawElementsBaseVertex(GL_TRIANGLES, cmd.count, indexType,
+                    reinterpret_cast<GLvoid*>(static_cast<size_t>(indexSize(indexType)) * cmd.firstIndex), cmd.baseVertex);
+                g_renderStats.addDraw(GL_TRIANGLES, cmd.count);
+            }
+        }
+
+        safe_glDisableVertexAttribArray(curSS.h_aPosition);
+        safe_glDisableVertexAttribArray(curSS.h_aNormal);
+        safe_glDisableVertexAttribArray(curSS.h_aTexCoord);
+    }
+};
+
+static shared_ptr<StaticSceneBatch> g_staticBatch; // NULL when unsupported
+static bool g_useStaticBatch = true;               // toggled with 'b'
+
+// The batch needs texture buffers (GL 3.1) and glDrawElementsBaseVertex (GL 3.2)
+static bool staticBatchSupported() {
+    return !g_Gl2Compatible && GLEW_VERSION_3_2;
+}
+
+
+// --------- Agent rendering
+
+
+// One unit sphere drawn once per agent with glDrawElementsInstanced. The
+// position and heading of every agent are gathered from the swarm into a
+// StreamBuffer each frame and read as a per-instance attribute, so the whole
+// crowd is one draw call.
+struct AgentRenderer {
+
+    GlVertexArrayObject vao;
+    GlBufferObject vbo, ibo;
+    StreamBuffer instances;
+    int iboLen;
+    GLenum indexType;
+
+    static const int FLOATS_PER_AGENT = 4;   // x, y, z, heading
+
+    AgentRenderer(const MeshData& mesh, int maxAgents)
+        : instances(GL_ARRAY_BUFFER, sizeof(GLfloat) * FLOATS_PER_AGENT * max(maxAgents, 1)),
+          iboLen(static_cast<int>(mesh.idx.size())), indexType(indexTypeFor(mesh.vtx.size())) {
+        glBindVertexArray(vao);
+
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(VertexPNT) * mesh.vtx.size(), &mesh.vtx[0], GL_STATIC_DRAW);
+
+        const vector<unsigned char> packedIdx = packIndices(&mesh.idx[0], mesh.idx.size(), indexType);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, packedIdx.size(), &packedIdx[0], GL_STATIC_DRAW);
+        checkGlErrors();
+    }
+
+    // Draws the agents moved back along their velocity by lag seconds, to
+    // interpolate between two ticks
+    void draw(const AgentShaderState& curSS, const AgentSwarm& agents, double lag) {
+        const int n = agents.size();
+        if (n == 0)
+            return;
+
+        instances.beginFrame();
+        GLintptr offset;
+        GLfloat* dst = static_cast<GLfloat*>(instances.allocate(sizeof(GLfloat) * FLOATS_PER_AGENT * n, sizeof(GLfloat), offset));
+        const GLfloat y = static_cast<GLfloat>(agents.y());
+        for (int i = 0; i < n; ++i, dst += FLOATS_PER_AGENT) {
+            const Cvec3 v = agents.velocity(i);
+            dst[0] = static_cast<GLfloat>(agents.x(i) - v[0] * lag);
+            dst[1] = y;
+            dst[2] = static_cast<GLfloat>(agents.z(i) - v[2] * lag);
+            dst[3] = static_cast<GLfloat>(agents.heading(i));
+        }
+        instances.flush();
+        g_renderStats.uploadBytes += sizeof(GLfloat) * FLOATS_PER_AGENT * n;
+
+        g_glState.bindVertexArray(vao);
+        safe_glEnableVertexAttribArray(curSS.h_aPosition);
+        safe_glEnableVertexAttribArray(curSS.h_aNormal);
+        safe_glEnableVertexAttribArray(curSS.h_aTexCoord);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        setVertexAttribPointers(curSS.h_aPosition, curSS.h_aNormal, curSS.h_aTexCoord, false);
+
+        if (curSS.h_aInstance >= 0) {
+            glEnableVertexAttribArray(curSS.h_aInstance);
+            glBindBuffer(GL_ARRAY_BUFFER, instances);
+            glVertexAttribPointer(curSS.h_aInstance, FLOATS_PER_AGENT, GL_FLOAT, GL_FALSE, 0, reinterpret_cast<GLvoid*>(offset));
+            glVertexAttribDivisor(curSS.h_aInstance, 1);
+        }
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+        glDrawElementsInstanced(GL_TRIANGLES, iboLen, indexType, 0, n);
+        g_renderStats.addDraw(GL_TRIANGLES, iboLen, n);
+
+        if (curSS.h_aInstance >= 0) {
+            glVertexAttribDivisor(curSS.h_aInstance, 0);
+            glDisableVertexAttribArray(curSS.h_aInstance);
+        }
+        safe_glDisableVertexAttribArray(curSS.h_aPosition);
+        safe_glDisableVertexAttribArray(curSS.h_aNormal);
+        safe_glDisableVertexAttribArray(curSS.h_aTexCoord);
+
+        instances.endFrame();
+    }
+};
+
+static shared_ptr<AgentRenderer> g_agentRenderer; // NULL when unsupported or without agents
+
+// Needs the core glVertexAttribDivisor of GL 3.3; ARB_instanced_arrays alone
+// only provides glVertexAttribDivisorARB
+static bool agentRenderingSupported() {
+    return !g_Gl2Compatible && GLEW_VERSION_3_3;
+}
+
+
+// takes the lights of the scene to eye space and send them to the shaders
+static void sendLights(const ShaderState& curSS, const Matrix4& invEyeRbt) {
+    const Cvec3 eyeLight1 = Cvec3(invEyeRbt * Cvec4(g_light1, 1));
+    const Cvec3 eyeLight2 = Cvec3(invEyeRbt * Cvec4(g_light2, 1));
+    safe_glUniform3f(curSS.h_uLight, eyeLight1[0], eyeLight1[1], eyeLight1[2]);
+    safe_glUniform3f(curSS.h_uLight2, eyeLight2[0], eyeLight2[1], eyeLight2[2]);
 }
 
 
-static vector<double> checkViewPositionRelativeToPlanes(const vector<Matrix4>& planeTransforms) {
-    //  ī޶ ġ
-    Cvec3 viewPosition(g_skyRbt(0, 3), g_skyRbt(1, 3), g_skyRbt(2, 3));
+// --------- Occlusion culling
+
+// Counters of one occlusion culling pass
+struct OcclusionStats {
+    int occluders;  // nodes drawn in the depth pre-pass
+    int queried;    // bounding boxes tested
+    int occluded;   // nodes skipped because their query failed last frame
+
+    OcclusionStats() : occluders(0), queried(0), occluded(0) {}
+};
+
+// Hardware occlusion culling of the scene nodes that survived frustum culling.
+// The largest nodes on screen are drawn first into depth only, then the
+// bounding box of every other node is rasterized inside an occlusion query.
+// To avoid stalling on the GPU, a node is skipped on the CPU using the result
+// of the query issued for it the previous frame, and the queries of this frame
+// drive conditional rendering of the nodes that do get drawn. A node that
+// comes into view therefore appears one frame late at worst.
+struct OcclusionCuller {
+
+    GLenum target;                  // best available query target
+    Geometry box;                   // cube spanning [-1, 1]^3
+    vector<GLuint> queries[2];      // per node, alternating between frames
+    vector<char> issued[2];         // whether queries[k][node] was issued
+    vector<char> visible;           // latest known result per node
+    vector<GLuint> conditions;      // query of this frame per node, 0 to draw unconditionally
+    vector<int> occluders, rest;    // this frame's partition of the frustum visible nodes
+    int frame;
+    OcclusionStats stats;
+
+    static const int MAX_OCCLUDERS = 16;
+
+    OcclusionCuller(int numNodes)
+        : box(createBox()), visible(numNodes, 1), conditions(numNodes, 0), frame(0) {
+        if (GLEW_VERSION_4_3 || GLEW_ARB_ES3_compatibility)
+            target = GL_ANY_SAMPLES_PASSED_CONSERVATIVE;
+        else if (GLEW_VERSION_3_3 || GLEW_ARB_occlusion_query2)
+            target = GL_ANY_SAMPLES_PASSED;
+        else
+            target = GL_SAMPLES_PASSED;
+
+        for (int k = 0; k < 2; ++k) {
+            queries[k].resize(numNodes);
+            glGenQueries(numNodes, &queries[k][0]);
+            issued[k].assign(numNodes, 0);
+        }
+        checkGlErrors();
+    }
+
+    ~OcclusionCuller() {
+        for (int k = 0; k < 2; ++k)
+            glDeleteQueries(static_cast<GLsizei>(queries[k].size()), &queries[k][0]);
+    }
+
+    static Geometry createBox() {
+        int vbLen, ibLen;
+        getCubeVbIbLen(vbLen, ibLen);
+        vector<VertexPNT> vtx(vbLen);
+        vector<unsigned short> idx(ibLen);
+        makeCube(2, vtx.begin(), idx.begin());
+        return Geometry(&vtx[0], &idx[0], vbLen, ibLen);
+    }
+
+    // Splits the frustum visible nodes into occluders and the rest, then drops
+    // from the rest the nodes found occluded last frame
+    void partition(const vector<int>& nodes, const Cvec3& eye) {
+        stats = OcclusionStats();
+        const int prev = frame & 1;
+
+        // collect last frame's results, without waiting for those not ready yet
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            const int n = nodes[i];
+            if (!issued[prev][n]) {
+                visible[n] = 1; // just entered the frustum, nothing known about it
+                continue;
+            }
+            GLuint available = 0, passed = 1;
+            glGetQueryObjectuiv(queries[prev][n], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available)
+                glGetQueryObjectuiv(queries[prev][n], GL_QUERY_RESULT, &passed);
+            visible[n] = passed != 0;
+        }
+
+        // the nodes that look largest from the eye make the best occluders
+        vector<pair<double, int> > bySize;
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            const Aabb& b = g_sceneBvh.box(nodes[i]);
+            const double d2 = max(norm2(b.center() - eye), 1e-6);
+            bySize.push_back(make_pair(-norm2(b.hi - b.lo) / d2, nodes[i]));
+        }
+        const size_t numOccluders = min(bySize.size(), static_cast<size_t>(MAX_OCCLUDERS));
+        partial_sort(bySize.begin(), bySize.begin() + numOccluders, bySize.end());
+
+        occluders.clear();
+        rest.clear();
+        for (size_t i = 0; i < bySize.size(); ++i) {
+            const int n = bySize[i].second;
+            if (i < numOccluders || containsEye(n, eye)) {
+                occluders.push_back(n);
+            }
+            else if (visible[n]) {
+                rest.push_back(n);
+            }
+            else {
+                ++stats.occluded;
+            }
+        }
+        stats.occluders = static_cast<int>(occluders.size());
+    }
+
+    // A box the eye is in (or too close to for the near plane) cannot be
+    // queried reliably, so its node is always drawn
+    static bool containsEye(int node, const Cvec3& eye) {
+        const Aabb& b = g_sceneBvh.box(node);
+        const double margin = 2 * abs(g_frustNear);
+        for (int k = 0; k < 3; ++k) {
+            if (eye[k] < b.lo[k] - margin || eye[k] > b.hi[k] + margin)
+                return false;
+        }
+        return true;
+    }
+
+    // Rasterizes the bounding box of every non-occluder node inside a query.
+    // Expects color and depth writes to be off.
+    void issueQueries(const ShaderState& curSS, const Matrix4& invEyeRbt, const vector<int>& nodes) {
+        const int cur = ++frame & 1;
+        issued[cur].assign(issued[cur].size(), 0);
+        conditions.assign(conditions.size(), 0);
+
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            const int n = nodes[i];
+            if (find(occluders.begin(), occluders.end(), n) != occluders.end())
+                continue;
+
+            // slightly inflated so a box never hides behind its own node
+            const Aabb& b = g_sceneBvh.box(n);
+            const Matrix4 MVM = invEyeRbt * Matrix4::makeTranslation(b.center()) *
+                Matrix4::makeScale(b.halfExtent() + Cvec3(0.01));
+            sendModelViewNormalMatrix(curSS, MVM, Matrix4());
+
+            glBeginQuery(target, queries[cur][n]);
+            box.draw(curSS);
+            glEndQuery(target);
+
+            issued[cur][n] = 1;
+            conditions[n] = queries[cur][n];
+            ++stats.queried;
+        }
+    }
+};
 
-    vector<double> relativeYPositions; //   
+static shared_ptr<OcclusionCuller> g_occlusionCuller;
+static bool g_occlusionCulling = true;     // toggled with 'o'
+
+
+// Draws the given scene nodes, through the static batch when it is enabled.
+// Per-node draws honour the conditional rendering queries if given.
+static void drawNodeList(const ShaderState& curSS, const Matrix4& projmat, const Matrix4& invEyeRbt,
+                         const vector<int>& nodes, const vector<GLuint>* conditions) {
+    if (g_staticBatch && g_useStaticBatch) {
+        // ground, 1, 2, 3, 3-3 and 3-1  in a single submission
+        const SceneShaderState& sceneSS = g_sceneShaderStates[g_activeShader];
+        g_glState.useProgram(sceneSS.program);
+        sendProjectionMatrix(sceneSS, projmat);
+        sendLights(sceneSS, invEyeRbt);
+        safe_glUniform3f(sceneSS.h_uColor, 0.0, 1.0, 0.0); // set color
+        glUniform1i(safe_glGetUniformLocation(sceneSS.program, "uTexture"), 0); // uTexture ؽó  0 
+
+        GLfloat glmatrix[16];
+        invEyeRbt.writeToColumnMajorMatrix(glmatrix);
+        safe_glUniformMatrix4fv(sceneSS.h_uViewMatrix, glmatrix);
+
+        g_staticBatch->draw(sceneSS, nodes, g_nodeLods);
+        g_glState.useProgram(curSS.program);
+    }
+    else {
+        safe_glUniform3f(curSS.h_uColor, 0.0, 1.0, 0.0); // set color
+        glUniform1i(safe_glGetUniformLocation(curSS.program, "uTexture"), 0); // uTexture ؽó  0 
+        drawSceneNodes(curSS, invEyeRbt, nodes, conditions);
+    }
+}
 
-    for (size_t i = 0; i < planeTransforms.size(); ++i) {
-        // Plane ߽ ǥ   
-        Cvec3 planeCenter(planeTransforms[i](0, 3), planeTransforms[i](1, 3), planeTransforms[i](2, 3));
-        Cvec3 planeNormal(planeTransforms[i](0, 1), planeTransforms[i](1, 1), planeTransforms[i](2, 1));
 
-        // ī޶ ġ Plane   Yǥ 
-        double relativeY = dot(viewPosition - planeCenter, planeNormal);
+// Picks the level of every visible node from the pixels its bounding sphere
+// covers, and counts the triangles that will be drawn
+static void selectLods(const Matrix4& eyeRbt, const vector<int>& nodes) {
+    const Cvec3 eye(eyeRbt(0, 3), eyeRbt(1, 3), eyeRbt(2, 3));
+    g_drawnTriangles = 0;
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        const int n = nodes[i];
+        const SceneNode& node = g_sceneNodes[n];
+        if (node.lods) {
+            const BoundingSphere sphere(g_sceneBvh.box(n));
+            const double size = projectedSize(sphere.radius, norm(sphere.center - eye), g_frustFovY, g_windowHeight);
+            g_nodeLods[n] = node.lods->select(size, g_nodeLods[n]);
+        }
+        g_drawnTriangles += static_cast<int>(g_staticMeshData[node.mesh + g_nodeLods[n]].numIndices()) / 3;
+    }
+}
+
 
-        //cout << "Plane " << i + 1 << " - Relative Y Position: " << relativeY << " ("
-        //    << (relativeY > 0 ? "Front" : (relativeY < 0 ? "Back" : "On the Plane")) << ")" << endl;
+// Deterministic hash of a tile and a salt, so a tile looks the same every time
+// it is paged in
+static unsigned tileHash(const TileCoord& t, unsigned salt) {
+    unsigned h = static_cast<unsigned>(t.x) * 0x8da6b343u ^ static_cast<unsigned>(t.z) * 0xd8163841u ^ salt * 0xcb1ab31fu;
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    return h;
+}
+
+// Builds the tile t of the world on the streaming thread: a flat ground grid
+// and a few corridor units at random places, none in the tile at the origin
+// whose corridors are built by buildScene. Only reads the static mesh data.
+static shared_ptr<WorldTile> loadWorldTile(const TileCoord& t) {
+    PROFILE_SCOPE("loadWorldTile");
+    shared_ptr<WorldTile> tile(new WorldTile);
+    const float x0 = static_cast<float>((t.x - 0.5) * g_tileSize), z0 = static_cast<float>((t.z - 0.5) * g_tileSize);
+    const float step = static_cast<float>(g_tileSize / g_tileGroundCells);
+
+    const int n = g_tileGroundCells;
+    for (int j = 0; j <= n; ++j) {
+        for (int i = 0; i <= n; ++i)
+            tile->ground.vtx.push_back(VertexPNT(x0 + step * i, g_groundY, z0 + step * j, 0, 1, 0,
+                                                 static_cast<float>(i) / n, static_cast<float>(j) / n));
+    }
+    for (int j = 0; j < n; ++j) {
+        for (int i = 0; i < n; ++i) {
+            const unsigned a = j * (n + 1) + i, b = a + n + 1;
+            const unsigned quad[] = { a, b, b + 1, a, b + 1, a + 1 };
+            tile->ground.idx.insert(tile->ground.idx.end(), quad, quad + 6);
+        }
+    }
+    tile->box = tile->ground.bounds();
+
+    if (t.x != 0 || t.z != 0) {
+        const int units = 1 + tileHash(t, 0) % 3;
+        const double margin = 15.0, span = g_tileSize - 2 * margin;
+        for (int u = 0; u < units; ++u) {
+            const double x = x0 + margin + span * (tileHash(t, 3 * u + 1) % 1024) / 1024.0;
+            const double z = z0 + margin + span * (tileHash(t, 3 * u + 2) % 1024) / 1024.0;
+            const double angle = 90.0 * (tileHash(t, 3 * u + 3) % 4);
+            createStructure(Matrix4::makeTranslation(Cvec3(x, 0.0, z)) * Matrix4::makeYRotation(angle),
+                            tile->walls);
+        }
+        for (size_t i = 0; i < tile->walls.size(); ++i) {
+            const Aabb meshBox = g_staticMeshData[tile->walls[i].mesh].bounds();
+            tile->wallBoxes.push_back(transformAabb(tile->walls[i].rbt, meshBox));
+            tile->colliders.add(WallRect(tile->walls[i].rbt, meshBox));
+            tile->box.add(tile->wallBoxes.back());
+        }
+        tile->colliders.build();
+    }
+    return tile;
+}
 
-        relativeYPositions.push_back(relativeY); //  
+// Takes in the tiles the streaming thread finished and uploads their ground,
+// and releases the GL objects of the evicted ones
+static void updateWorld(const Cvec3& eye) {
+    PROFILE_SCOPE("updateWorld");
+    vector<TileStreamer<WorldTile>::Entry> loaded, evicted;
+    g_world->update(eye, loaded, evicted);
+    for (size_t i = 0; i < loaded.size(); ++i) {
+        MeshData& ground = loaded[i].second->ground;
+        loaded[i].second->groundGeometry.reset(new Geometry(&ground.vtx[0], &ground.idx[0],
+            static_cast<int>(ground.vtx.size()), static_cast<int>(ground.idx.size())));
+        ground = MeshData();
     }
-    //cout << "==================================================" << endl;
-    return relativeYPositions; // Y ǥ  ȯ
+    for (size_t i = 0; i < evicted.size(); ++i)
+        evicted[i].second->groundGeometry.reset();
 }
 
+// Draws the ground and walls of the resident tiles inside the frustum
+static void drawWorldTiles(const ShaderState& curSS, const Frustum& frustum, const Matrix4& invEyeRbt) {
+    g_world->forEach([&](const TileCoord&, WorldTile& tile) {
+        if (!tile.groundGeometry || frustum.classify(tile.box) == CULL_OUTSIDE)
+            return;
+        sendModelViewNormalMatrix(curSS, invEyeRbt, normalMatrix(invEyeRbt));
+        tile.groundGeometry->draw(curSS);
+        for (size_t i = 0; i < tile.walls.size(); ++i) {
+            if (frustum.classify(tile.wallBoxes[i]) == CULL_OUTSIDE)
+                continue;
+            const Matrix4 MVM = invEyeRbt * tile.walls[i].rbt;
+            sendModelViewNormalMatrix(curSS, MVM, normalMatrix(MVM));
+            g_staticMeshes[tile.walls[i].mesh].draw(curSS);
+        }
+    });
+}
+
+// Draws the agents where they were lag seconds before their last tick
+static void drawAgents(double lag) {
+    PROFILE_SCOPE("drawAgents");
+    const AgentShaderState& agentSS = g_agentShaderStates[g_activeShader];
+    g_glState.useProgram(agentSS.program);
+
+    const Matrix4 invEyeRbt = inv(g_skyRbt);
+    sendProjectionMatrix(agentSS, makeProjectionMatrix());
+    sendLights(agentSS, invEyeRbt);
+    safe_glUniform3f(agentSS.h_uColor, 1.0, 0.5, 0.0);
+    glUniform1i(safe_glGetUniformLocation(agentSS.program, "uTexture"), 0);
+    safe_glUniform3f(agentSS.h_uAgentScale, 1.6 * g_agentRadius, g_agentRadius, g_agentRadius);
+
+    GLfloat glmatrix[16];
+    invEyeRbt.writeToColumnMajorMatrix(glmatrix);
+    safe_glUniformMatrix4fv(agentSS.h_uViewMatrix, glmatrix);
+
+    g_agentRenderer->draw(agentSS, *g_agents, lag);
+}
+
+// The rigid body transform of the eye between the ticks a and b, at alpha in [0, 1]
+static Matrix4 interpolateEye(const EyeState& a, const EyeState& b, double alpha) {
+    const Cvec3 position = a.position * (1 - alpha) + b.position * alpha;
+    return Matrix4::makeTranslation(position) *
+        Matrix4::makeYRotation(a.yaw * (1 - alpha) + b.yaw * alpha) *
+        Matrix4::makeXRotation(a.pitch * (1 - alpha) + b.pitch * alpha);
+}
+
+// The cull phase of a frame: places the eye between the last two ticks,
+// pages the world around it and picks the nodes to draw and their levels
+static void cull() {
+    PROFILE_SCOPE("cull");
+    g_skyRbt = interpolateEye(g_prevEye, g_eye, g_tickAccumulator / g_tickSeconds);
 
+    const Matrix4 projmat = makeProjectionMatrix();
+    const Matrix4 eyeRbt = g_skyRbt;
+    const Matrix4 invEyeRbt = inv(eyeRbt);
+
+    if (g_world)
+        updateWorld(Cvec3(eyeRbt(0, 3), eyeRbt(1, 3), eyeRbt(2, 3)));
+
+    // keep only the nodes inside the view frustum
+    g_visibleNodes.clear();
+    g_cullStats = CullStats();
+    g_portalStats = PortalStats();
+    g_eyeInCell = false;
+    if (g_frustumCulling) {
+        const Frustum frustum(projmat * invEyeRbt);
+        if (g_portalCulling && !g_sceneCells.empty())
+            g_eyeInCell = g_cells.traverse(Cvec3(eyeRbt(0, 3), eyeRbt(1, 3), eyeRbt(2, 3)), frustum, g_visibleNodes, g_portalStats);
+        if (g_eyeInCell) {
+            g_cullStats.tested = g_portalStats.portalsTested + g_portalStats.objectsTested;
+            g_cullStats.drawn = static_cast<int>(g_visibleNodes.size());
+            g_cullStats.culled = static_cast<int>(g_sceneNodes.size()) - g_cullStats.drawn;
+        }
+        else {
+            g_sceneBvh.cull(frustum, g_visibleNodes, g_cullStats);
+        }
+    }
+    else {
+        for (int i = 0; i < static_cast<int>(g_sceneNodes.size()); ++i)
+            g_visibleNodes.push_back(i);
+        g_cullStats.drawn = static_cast<int>(g_visibleNodes.size());
+    }
+
+    selectLods(eyeRbt, g_visibleNodes);
+}
+
+// Draws what cull picked
 static void drawStuff() {
+    PROFILE_SCOPE("drawStuff");
     // short hand for current shader state
-    const ShaderState& curSS = *g_shaderStates[g_activeShader];
+    const ShaderState& curSS = g_shaderStates[g_activeShader];
 
     // build & send proj. matrix to vshader
     const Matrix4 projmat = makeProjectionMatrix();
@@ -395,62 +1559,532 @@ static void drawStuff() {
     // use the skyRbt as the eyeRbt
     const Matrix4 eyeRbt = g_skyRbt;
     const Matrix4 invEyeRbt = inv(eyeRbt);
-
-    const Cvec3 eyeLight1 = Cvec3(invEyeRbt * Cvec4(g_light1, 1));
-    const Cvec3 eyeLight2 = Cvec3(invEyeRbt * Cvec4(g_light2, 1));
-    safe_glUniform3f(curSS.h_uLight, eyeLight1[0], eyeLight1[1], eyeLight1[2]);
-    safe_glUniform3f(curSS.h_uLight2, eyeLight2[0], eyeLight2[1], eyeLight2[2]);
-
-    // draw ground
-    const Matrix4 groundRbt = Matrix4();  // identity
-    Matrix4 MVM = invEyeRbt * groundRbt;
-    Matrix4 NMVM = normalMatrix(MVM);
-    sendModelViewNormalMatrix(curSS, MVM, NMVM);
-    safe_glUniform3f(curSS.h_uColor, 0.0, 1.0, 0.0); // set color
-    g_ground->draw(curSS);
-
-    //  Plane ȯ  
-    vector<Matrix4> planeTransforms;
+    sendLights(curSS, invEyeRbt);
 
     //  ؽó Ȱȭ ( ؽó )
     glActiveTexture(GL_TEXTURE0);          // Ȱȭ ؽó 
     glBindTexture(GL_TEXTURE_2D, wallTextureID); //  ؽó ε
-    glUniform1i(safe_glGetUniformLocation(curSS.program, "uTexture"), 0); // uTexture ؽó  0 
-    // ī޶ Plane  ġ   
-    checkViewPositionRelativeToPlanes(planeTransforms);
- 
+
+    if (g_world) {
+        GpuPass pass(*g_gpuProfiler, "world");
+        drawWorldTiles(curSS, Frustum(projmat * invEyeRbt), invEyeRbt);
+    }
+
+    if (!(g_occlusionCuller && g_occlusionCulling)) {
+        GpuPass pass(*g_gpuProfiler, "scene");
+        drawNodeList(curSS, projmat, invEyeRbt, g_visibleNodes, NULL);
+        return;
+    }
+
+    OcclusionCuller& occlusion = *g_occlusionCuller;
+    occlusion.partition(g_visibleNodes, Cvec3(eyeRbt(0, 3), eyeRbt(1, 3), eyeRbt(2, 3)));
+
+    // depth pre-pass of the large occluders, then the bounding box queries
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    {
+        GpuPass pass(*g_gpuProfiler, "occluder depth");
+        drawNodeList(curSS, projmat, invEyeRbt, occlusion.occluders, NULL);
+    }
+    glDepthMask(GL_FALSE);
+    {
+        GpuPass pass(*g_gpuProfiler, "occlusion queries");
+        occlusion.issueQueries(curSS, invEyeRbt, g_visibleNodes);
+    }
+    glDepthMask(GL_TRUE);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+    // the occluders are already in the depth buffer, so they pass with equal depth
+    GpuPass pass(*g_gpuProfiler, "scene");
+    glDepthFunc(GL_GEQUAL);
+    drawNodeList(curSS, projmat, invEyeRbt, occlusion.occluders, NULL);
+    glDepthFunc(GL_GREATER);
+    drawNodeList(curSS, projmat, invEyeRbt, occlusion.rest, &occlusion.conditions);
+}
+
+
+// Builds g_cells from the cells and portals the scene declares. A node goes
+// into every cell its xz footprint overlaps (the ground into all of them) and
+// into the outside, the first cell with empty bounds; nodes outside every
+// cell, e.g. the maze, only into the outside, where they are culled through
+// their own BVH.
+static void initCells(const vector<Aabb>& boxes) {
+    int outside = -1;
+    for (size_t i = 0; i < g_sceneCells.size(); ++i) {
+        const int c = g_cells.addCell(g_sceneCells[i]);
+        if (outside < 0 && g_sceneCells[i].isEmpty())
+            outside = c;
+    }
+    for (size_t i = 0; i < g_scenePortals.size(); ++i)
+        g_cells.addPortal(g_scenePortals[i].cells[0], g_scenePortals[i].cells[1], g_scenePortals[i].rect);
+    if (g_sceneCells.empty())
+        return;
+
+    const double eps = 1e-3;
+    vector<int> outsideNodes;
+    for (int i = 0; i < static_cast<int>(boxes.size()); ++i) {
+        const Aabb& box = boxes[i];
+        bool inCell = false;
+        for (int c = 0; c < g_cells.numCells(); ++c) {
+            const Aabb& b = g_cells.bounds(c);
+            if (!b.isEmpty() &&
+                box.lo[0] <= b.hi[0] + eps && box.hi[0] >= b.lo[0] - eps &&
+                box.lo[2] <= b.hi[2] + eps && box.hi[2] >= b.lo[2] - eps) {
+                g_cells.addObject(c, i, box);
+                inCell = true;
+            }
+        }
+        if (!inCell)
+            outsideNodes.push_back(i);
+        else if (outside >= 0)
+            g_cells.addObject(outside, i, box);
+    }
+    if (outside >= 0) {
+        g_outsideBvh.build(boxes, outsideNodes);
+        g_cells.setObjects(outside, &g_outsideBvh);
+    }
+}
+
+// Declares the cells of the corridor structures and the openings between them:
+// the hub, a cell per corridor and the outside, which the entrance corridor
+// opens into and every corridor through its missing roof
+static void declareCorridorCells() {
+    const double y0 = g_groundY, y1 = 3.0;     // walls span y = 0.5 +- 2.5
+    enum { HUB, NORTH, EAST, WEST, SOUTH, OUTSIDE };
+
+    g_sceneCells.push_back(Aabb(Cvec3(-2.5, y0, -2.5), Cvec3(2.5, y1, 2.5)));
+    g_sceneCells.push_back(Aabb(Cvec3(-2.5, y0, -12.5), Cvec3(2.5, y1, -2.5)));      // 1
+    g_sceneCells.push_back(Aabb(Cvec3(2.5, y0, -2.5), Cvec3(12.5, y1, 2.5)));         // 2
+    g_sceneCells.push_back(Aabb(Cvec3(-12.5, y0, -2.5), Cvec3(-2.5, y1, 2.5)));       // 3
+    g_sceneCells.push_back(Aabb(Cvec3(-2.5, y0, 2.5), Cvec3(2.5, y1, 12.5)));        // 3-1, 3-3  
+    g_sceneCells.push_back(Aabb());
+
+    g_scenePortals.push_back(ScenePortal(HUB, NORTH, Aabb(Cvec3(-2.5, y0, -2.5), Cvec3(2.5, y1, -2.5))));
+    g_scenePortals.push_back(ScenePortal(HUB, EAST, Aabb(Cvec3(2.5, y0, -2.5), Cvec3(2.5, y1, 2.5))));
+    g_scenePortals.push_back(ScenePortal(HUB, WEST, Aabb(Cvec3(-2.5, y0, -2.5), Cvec3(-2.5, y1, 2.5))));
+    g_scenePortals.push_back(ScenePortal(HUB, SOUTH, Aabb(Cvec3(-2.5, y0, 2.5), Cvec3(2.5, y1, 2.5))));
+    g_scenePortals.push_back(ScenePortal(SOUTH, OUTSIDE, Aabb(Cvec3(-2.5, y0, 12.5), Cvec3(2.5, y1, 12.5))));
+
+    // the corridors have no roof
+    for (int c = HUB; c < OUTSIDE; ++c) {
+        Aabb roof = g_sceneCells[c];
+        roof.lo[1] = y1;
+        g_scenePortals.push_back(ScenePortal(c, OUTSIDE, roof));
+    }
+}
+
+
+// Builds the static scene on the CPU: ground, the three corridor structures,
+// the two walls of the entrance corridor and a sphere in each corridor, and
+// the cells of the corridors. Fills in the world box of every node.
+static void buildScene(vector<Aabb>& boxes) {
+    g_staticMeshData.resize(NUM_STATIC_MESHES);
+    g_staticMeshData[MESH_GROUND] = createGround();
+    g_staticMeshData[MESH_WALL_5x10] = createTexturedPlane(5.0, 10.0);
+    g_staticMeshData[MESH_WALL_5x5] = createTexturedPlane(5.0, 5.0);
+    Aabb sphereBox;
+    for (int i = 0; i < 4; ++i) {
+        g_staticMeshData[MESH_SPHERE + i] = createSphere(1.0, g_sphereLodSlices[i]);
+        sphereBox.add(g_staticMeshData[MESH_SPHERE + i].bounds());
+    }
+    for (int i = 0; i < 4; ++i)
+        g_staticMeshData[MESH_SPHERE + i].packBox = sphereBox;
+
+    // an imported asset after the built-in meshes
+    int importedMesh = -1;
+    if (g_importFile) {
+        const ImportedMesh imported = importMesh(g_importFile);
+        if (imported.idx.empty())
+            throw runtime_error(string("No triangles in ") + g_importFile);
+        MeshData mesh;
+        mesh.vtx.assign(imported.vtx.begin(), imported.vtx.end());
+        mesh.idx = imported.idx;
+        g_staticMeshData.push_back(mesh);
+        importedMesh = static_cast<int>(g_staticMeshData.size()) - 1;
+        optimizeMesh(g_staticMeshData[importedMesh], g_importFile);
+    }
+
+    // finest level from 400 pixels up, coarsest below 50 pixels
+    g_meshLods.assign(g_staticMeshData.size(), LodChain());
+    g_meshLods[MESH_SPHERE].addLevel(400);
+    g_meshLods[MESH_SPHERE].addLevel(150);
+    g_meshLods[MESH_SPHERE].addLevel(50);
+    g_meshLods[MESH_SPHERE].addLevel(0);
+
+    static const char* const meshNames[NUM_STATIC_MESHES] = {
+        "ground", "wall 5x10", "wall 5x5", "sphere", "sphere lod 1", "sphere lod 2", "sphere lod 3"
+    };
+    for (int i = 0; i < NUM_STATIC_MESHES; ++i)
+        optimizeMesh(g_staticMeshData[i], meshNames[i]);
+
+    // ground, unless the world tiles provide it
+    if (!g_worldBudget)
+        g_sceneNodes.push_back(SceneNode(MESH_GROUND, Matrix4()));
 
     // 1
-    createStructure(curSS, Matrix4::makeTranslation(Cvec3(0.0, 0.0, 0.0)), planeTransforms);
+    createStructure(Matrix4::makeTranslation(Cvec3(0.0, 0.0, 0.0)), g_sceneNodes);
 
     // 2
-    createStructure(curSS, Matrix4::makeTranslation(Cvec3(0.0, 0.0, 0.0)) * Matrix4::makeYRotation(-90), planeTransforms);
+    createStructure(Matrix4::makeTranslation(Cvec3(0.0, 0.0, 0.0)) * Matrix4::makeYRotation(-90), g_sceneNodes);
 
     // 3
-    createStructure(curSS, Matrix4::makeTranslation(Cvec3(0.0, 0.0, 0.0)) * Matrix4::makeYRotation(90), planeTransforms);
+    createStructure(Matrix4::makeTranslation(Cvec3(0.0, 0.0, 0.0)) * Matrix4::makeYRotation(90), g_sceneNodes);
 
     // 3-3 
-    auto Plane_3_3 = createTexturedPlane(5.0, 10.0);
-    drawPlane(curSS, Plane_3_3, Matrix4::makeTranslation(Cvec3(-2.5, 0.5, 7.5)) * Matrix4::makeZRotation(90));
+    g_sceneNodes.push_back(SceneNode(MESH_WALL_5x10, Matrix4::makeTranslation(Cvec3(-2.5, 0.5, 7.5)) * Matrix4::makeZRotation(90), NULL, true));
 
     // 3-1 
-    auto Plane_3_1 = createTexturedPlane(5.0, 10.0);
-    drawPlane(curSS, Plane_3_1, Matrix4::makeTranslation(Cvec3(2.5, 0.5, 7.5)) * Matrix4::makeZRotation(90));
+    g_sceneNodes.push_back(SceneNode(MESH_WALL_5x10, Matrix4::makeTranslation(Cvec3(2.5, 0.5, 7.5)) * Matrix4::makeZRotation(90), NULL, true));
+    declareCorridorCells();
+
+    // a sphere resting on the ground at the end of each corridor
+    g_sceneNodes.push_back(SceneNode(MESH_SPHERE, Matrix4::makeTranslation(Cvec3(0.0, g_groundY + 1.0, -10.0)), &g_meshLods[MESH_SPHERE]));
+    g_sceneNodes.push_back(SceneNode(MESH_SPHERE, Matrix4::makeTranslation(Cvec3(10.0, g_groundY + 1.0, 0.0)), &g_meshLods[MESH_SPHERE]));
+    g_sceneNodes.push_back(SceneNode(MESH_SPHERE, Matrix4::makeTranslation(Cvec3(-10.0, g_groundY + 1.0, 0.0)), &g_meshLods[MESH_SPHERE]));
+
+    // the imported asset, scaled to 2 units and standing on the ground of the entrance corridor
+    if (importedMesh >= 0) {
+        const Aabb box = g_staticMeshData[importedMesh].bounds();
+        const Cvec3 extent = box.hi - box.lo, center = box.center();
+        const double scale = 2.0 / max(max(extent[0], extent[1]), max(extent[2], CS175_EPS));
+        g_sceneNodes.push_back(SceneNode(importedMesh, Matrix4::makeTranslation(Cvec3(0.0, g_groundY, 7.5)) *
+            Matrix4::makeScale(Cvec3(scale, scale, scale)) * Matrix4::makeTranslation(Cvec3(-center[0], -box.lo[1], -center[2]))));
+    }
+    if (g_mazeWidth > 0 && g_mazeDepth > 0)
+        createMaze(g_mazeWidth, g_mazeDepth, g_mazeSeed, g_sceneNodes);
+
+    // exact world boxes of the nodes for culling, from the transformed vertices
+    vector<MeshSoA> meshStreams(g_staticMeshData.size());
+    for (size_t i = 0; i < g_staticMeshData.size(); ++i)
+        meshStreams[i].gather(vertexSpan(g_staticMeshData[i].vtx), g_staticMeshData[i].vtx.size());
+    for (size_t i = 0; i < g_sceneNodes.size(); ++i)
+        boxes.push_back(meshStreams[g_sceneNodes[i].mesh].transformedBounds(g_sceneNodes[i].rbt));
+}
+
+static void writeBox(const Aabb& box, float lo[3], float hi[3]) {
+    for (int k = 0; k < 3; ++k) {
+        lo[k] = static_cast<float>(box.lo[k]);
+        hi[k] = static_cast<float>(box.hi[k]);
+    }
+}
+
+static Aabb readBox(const float lo[3], const float hi[3]) {
+    return Aabb(Cvec3(lo[0], lo[1], lo[2]), Cvec3(hi[0], hi[1], hi[2]));
+}
+
+// Builds the scene in code and writes it to a scene file, for --scene.
+// Run with --export-scene <file>, needs no window.
+static void exportScene(const char* filename) {
+    vector<Aabb> boxes;
+    buildScene(boxes);
+
+    // Vertices are stored packed and indices narrowed, all meshes with the same
+    // index type so that the batch can take them as they are
+    size_t maxMeshVertices = 0;
+    for (size_t i = 0; i < g_staticMeshData.size(); ++i)
+        maxMeshVertices = max(maxMeshVertices, g_staticMeshData[i].vtx.size());
+    const GLenum indexType = indexTypeFor(maxMeshVertices);
+
+    SceneFileWriter writer;
+    const int material = writer.addMaterial(g_textureFile.c_str());
+    int chain = 0;  // first mesh of the chain the current mesh belongs to
+    for (int i = 0; i < static_cast<int>(g_staticMeshData.size()); ++i) {
+        const MeshData& mesh = g_staticMeshData[i];
+        if (i - chain >= max(g_meshLods[chain].numLevels(), 1))
+            chain = i;
+
+        SceneFileMesh desc;
+        memset(&desc, 0, sizeof(desc));
+        desc.vertexStride = sizeof(VertexPNTPacked);
+        desc.vertexFormat = SCENE_VERTEX_PNT_PACKED;
+        desc.indexType = indexType;
+        desc.material = material;
+        desc.lodLevel = i - chain;
+        desc.lodMinSize = g_meshLods[chain].numLevels() ? static_cast<float>(g_meshLods[chain].minSize(i - chain)) : 0;
+        writeBox(mesh.bounds(), desc.boundsLo, desc.boundsHi);
+        writeBox(mesh.packBox.isEmpty() ? mesh.bounds() : mesh.packBox, desc.packLo, desc.packHi);
+        // quantised against the box as stored, which a loader dequantises with
+        const Aabb packBox = readBox(desc.packLo, desc.packHi);
+        const vector<VertexPNTPacked> packed = packVertices(mesh.vertices(), mesh.numVertices(),
+                                                            PositionQuantization(packBox.lo, packBox.hi));
+        const vector<unsigned char> packedIdx = packIndices(mesh.indices(), mesh.idx.size(), indexType);
+        writer.addMesh(desc, packed.empty() ? NULL : &packed[0], static_cast<unsigned>(packed.size()),
+                       packedIdx.empty() ? NULL : &packedIdx[0], static_cast<unsigned>(mesh.idx.size()));
+    }
+
+    for (size_t i = 0; i < g_sceneNodes.size(); ++i) {
+        const SceneNode& node = g_sceneNodes[i];
+        SceneFileNode n;
+        memset(&n, 0, sizeof(n));
+        for (int j = 0; j < 16; ++j)
+            n.rbt[j] = node.rbt(j / 4, j % 4);
+        writeBox(boxes[i], n.boundsLo, n.boundsHi);
+        n.mesh = node.mesh;
+        n.flags = (node.collider ? SCENE_NODE_COLLIDER : 0) | (node.lods ? SCENE_NODE_LODS : 0);
+        writer.addNode(n);
+    }
+
+    for (size_t i = 0; i < g_sceneCells.size(); ++i) {
+        SceneFileCell c;
+        writeBox(g_sceneCells[i], c.boundsLo, c.boundsHi);
+        writer.addCell(c);
+    }
+    for (size_t i = 0; i < g_scenePortals.size(); ++i) {
+        SceneFilePortal p;
+        p.cells[0] = g_scenePortals[i].cells[0];
+        p.cells[1] = g_scenePortals[i].cells[1];
+        writeBox(g_scenePortals[i].rect, p.rectLo, p.rectHi);
+        writer.addPortal(p);
+    }
+
+    writer.write(filename);
+    cout << "Wrote " << g_staticMeshData.size() << " meshes, " << g_sceneNodes.size() << " nodes and "
+        << g_sceneCells.size() << " cells to " << filename << endl;
+}
+
+// Maps a scene file written by exportScene and takes its meshes, level of
+// detail chains, nodes, boxes, cells and portals as they are, without generating or
+// optimising anything. The meshes are read in place, so the file stays
+// mapped in g_sceneFileData. With verify every index is checked as well.
+static void loadScene(const char* filename, bool verify, vector<Aabb>& boxes) {
+    g_sceneFileData.reset(new SceneFile(filename, verify));
+    const SceneFile& file = *g_sceneFileData;
+    const int numMeshes = file.numMeshes();
+
+    g_staticMeshData.resize(numMeshes);
+    g_meshLods.assign(numMeshes, LodChain());
+    int chain = 0;
+    for (int i = 0; i < numMeshes; ++i) {
+        // the batch takes all meshes in one layout
+        const SceneFileMesh& m = file.mesh(i);
+        if (m.vertexFormat != file.mesh(0).vertexFormat || m.indexType != file.mesh(0).indexType)
+            throw runtime_error(string("Meshes of different layouts in ") + filename);
+
+        MeshData& mesh = g_staticMeshData[i];
+        mesh.file = &file;
+        mesh.fileMesh = i;
+        mesh.packBox = readBox(m.packLo, m.packHi);
+
+        if (m.lodLevel == 0)
+            chain = i;
+        if (m.lodLevel != 0 || (i + 1 < numMeshes && file.mesh(i + 1).lodLevel != 0))
+            g_meshLods[chain].addLevel(m.lodMinSize);
+    }
+
+    for (int i = 0; i < file.numNodes(); ++i) {
+        const SceneFileNode& n = file.node(i);
+        Matrix4 rbt;
+        for (int j = 0; j < 16; ++j)
+            rbt(j / 4, j % 4) = n.rbt[j];
+        const LodChain* lods = NULL;
+        if (n.flags & SCENE_NODE_LODS) {
+            if (g_meshLods[n.mesh].numLevels() == 0)
+                throw runtime_error(string("Node without a level of detail chain in ") + filename);
+            lods = &g_meshLods[n.mesh];
+        }
+        g_sceneNodes.push_back(SceneNode(n.mesh, rbt, lods, (n.flags & SCENE_NODE_COLLIDER) != 0));
+        boxes.push_back(readBox(n.boundsLo, n.boundsHi));
+    }
+
+    for (int i = 0; i < file.numCells(); ++i)
+        g_sceneCells.push_back(readBox(file.cell(i).boundsLo, file.cell(i).boundsHi));
+    for (int i = 0; i < file.numPortals(); ++i) {
+        const SceneFilePortal& p = file.portal(i);
+        g_scenePortals.push_back(ScenePortal(p.cells[0], p.cells[1], readBox(p.rectLo, p.rectHi)));
+    }
+
+    if (file.numMaterials() > 0)
+        g_textureFile = file.material(0).texture;
+    cout << "Loaded " << numMeshes << " meshes, " << file.numNodes() << " nodes and "
+        << file.numCells() << " cells from " << filename << endl;
+}
+
+// Uploads the static meshes and builds the culling structures and the batch
+// over the scene nodes, whose world boxes are given
+static void uploadScene(const vector<Aabb>& boxes) {
+    // a loaded scene goes to GL as it is stored, unpacked only if GL cannot
+    // fetch packed vertices
+    g_packedVertices = packedVerticesSupported();
+    if (g_sceneFileData && g_sceneFileData->numMeshes() > 0)
+        g_packedVertices = g_packedVertices && g_sceneFileData->mesh(0).vertexFormat == SCENE_VERTEX_PNT_PACKED;
+    size_t vertexBytes = 0;
+    for (size_t i = 0; i < g_staticMeshData.size(); ++i) {
+        MeshData& mesh = g_staticMeshData[i];
+        const int vboLen = mesh.numVertices(), iboLen = mesh.numIndices();
+        if (mesh.file) {
+            vector<VertexPNT> unpacked;
+            const GLenum indexType = mesh.file->mesh(mesh.fileMesh).indexType;
+            g_staticMeshes.push_back(Geometry(fileVertices(mesh, g_packedVertices, unpacked), vboLen, g_packedVertices,
+                                              mesh.quantization(), mesh.file->indices(mesh.fileMesh), iboLen, indexType));
+            vertexBytes += (g_packedVertices ? sizeof(VertexPNTPacked) : sizeof(VertexPNT)) * vboLen;
+        }
+        else if (g_packedVertices) {
+            vector<VertexPNTPacked> packed = packVertices(mesh.vertices(), mesh.numVertices(), mesh.quantization());
+            g_staticMeshes.push_back(Geometry(&packed[0], &mesh.idx[0], vboLen, iboLen, mesh.quantization()));
+            vertexBytes += sizeof(VertexPNTPacked) * vboLen;
+        }
+        else {
+            g_staticMeshes.push_back(Geometry(&mesh.vtx[0], &mesh.idx[0], vboLen, iboLen));
+            vertexBytes += sizeof(VertexPNT) * vboLen;
+        }
+    }
+    cout << "Static vertices: " << vertexBytes << " bytes" << (g_packedVertices ? " (packed)" : "") << endl;
+
+    vector<Aabb> meshBoxes;
+    for (size_t i = 0; i < g_staticMeshData.size(); ++i)
+        meshBoxes.push_back(g_staticMeshData[i].bounds());
+    for (size_t i = 0; i < g_sceneNodes.size(); ++i) {
+        if (g_sceneNodes[i].collider)
+            g_walls.add(WallRect(g_sceneNodes[i].rbt, meshBoxes[g_sceneNodes[i].mesh]));
+    }
+    g_walls.build();
+
+    g_nodeLods.assign(g_sceneNodes.size(), 0);
+    g_sceneBvh.build(boxes);
+    g_visibleNodes.reserve(g_sceneNodes.size());
+    initCells(boxes);
 
+    if (staticBatchSupported())
+        g_staticBatch.reset(new StaticSceneBatch(g_staticMeshData, g_sceneNodes, g_packedVertices));
 
+    // conditional rendering is core since GL 3.0
+    if (GLEW_VERSION_3_0)
+        g_occlusionCuller.reset(new OcclusionCuller(static_cast<int>(g_sceneNodes.size())));
 }
 
-static void display() {
-    glUseProgram(g_shaderStates[g_activeShader]->program);
+// Scatters the agents over the area of the walls, or around the hub if there
+// are none, and prepares their instanced drawing
+static void initAgents() {
+    Aabb area;
+    for (int i = 0; i < g_walls.size(); ++i)
+        area.add(g_walls.wall(i).bounds());
+    if (area.isEmpty())
+        area = Aabb(Cvec3(-20, 0, -20), Cvec3(20, 0, 20));
+
+    g_jobs.reset(new JobSystem());
+    g_agents.reset(new AgentSwarm(g_agentRadius, g_groundY + g_agentRadius, 2.0, 1.5));
+    g_agents->spawn(g_numAgents, area, g_walls, g_mazeSeed);
+    cout << "Agents: " << g_numAgents << " on " << g_jobs->numThreads() << " threads" << endl;
+
+    if (agentRenderingSupported())
+        g_agentRenderer.reset(new AgentRenderer(createSphere(1.0, g_sphereLodSlices[2]), g_numAgents));
+    else
+        cout << "Agents are simulated but not drawn, instancing is unsupported" << endl;
+}
+
+static void initScene() {
+    PROFILE_SCOPE("initScene");
+    vector<Aabb> boxes;
+    if (g_sceneFile)
+        loadScene(g_sceneFile, g_verifyScene, boxes);
+    else
+        buildScene(boxes);
+    uploadScene(boxes);
+
+    if (g_worldBudget)
+        g_world.reset(new TileStreamer<WorldTile>(g_tileSize, g_worldRadius, g_worldBudget, loadWorldTile));
+
+    if (g_numAgents)
+        initAgents();
+}
+
+// Adds a line of printf formatted text to the HUD and moves y past it
+static void hudLine(int x, int& y, unsigned color, const char* format, ...) {
+    char line[128];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    g_hud->text(x, y, line, color, 2);
+    y += 2 * Hud::GLYPH_HEIGHT + 4;
+}
+
+// Draws the performance overlay: the frame rate, graphs of the CPU and GPU
+// time of the last frames against the 60 Hz budget, then what this frame drew
+// and culled. The CPU time leaves out presenting and waiting, and the GPU
+// time trails by the frames the queries take to come back.
+static void drawHud() {
+    PROFILE_SCOPE("drawHud");
+    const double cpuMs = g_frameLoop.lastMs(FRAME_INPUT) + g_frameLoop.lastMs(FRAME_UPDATE) +
+        g_frameLoop.lastMs(FRAME_CULL) + g_frameLoop.lastMs(FRAME_RENDER);
+    const double gpuMs = g_gpuProfiler->lastMs("frame");
+    const int slot = static_cast<int>(g_hudFrames++ % g_hudGraphFrames);
+    g_cpuMsHistory[slot] = static_cast<float>(cpuMs);
+    g_gpuMsHistory[slot] = static_cast<float>(gpuMs);
+    const int oldest = static_cast<int>(g_hudFrames % g_hudGraphFrames);
+
+    const bool occlusion = g_occlusionCuller && g_occlusionCulling;
+    const unsigned white = Hud::rgba(255, 255, 255), over = Hud::rgba(255, 70, 50);
+    const int x = 16, lineHeight = 2 * Hud::GLYPH_HEIGHT + 4, graphWidth = 2 * g_hudGraphFrames, graphHeight = 40;
+    const float maxMs = 1000.0f / 30, budgetMs = 1000.0f / 60;
+    const int lines = 7 + (occlusion ? 1 : 0) + (g_eyeInCell ? 1 : 0);
+
+    g_hud->begin(g_windowWidth, g_windowHeight);
+    g_hud->rect(8, 8, 34 * 2 * Hud::GLYPH_WIDTH + 16, lines * lineHeight + 2 * (graphHeight + 6) + 12, Hud::rgba(0, 0, 0, 150));
+
+    int y = 16;
+    const double frameMs = g_frameLoop.meanFrameMs();
+    hudLine(x, y, white, "FPS %.1f  FRAME %.2f MS", frameMs > 0 ? 1000 / frameMs : 0.0, frameMs);
+
+    hudLine(x, y, white, "CPU %.2f MS", cpuMs);
+    g_hud->graph(x, y, graphWidth, graphHeight, g_cpuMsHistory, g_hudGraphFrames, oldest, maxMs, budgetMs,
+                 Hud::rgba(90, 220, 90), over);
+    y += graphHeight + 6;
+
+    if (g_gpuProfiler->supported())
+        hudLine(x, y, white, "GPU %.2f MS", gpuMs);
+    else
+        hudLine(x, y, white, "GPU N/A");
+    g_hud->graph(x, y, graphWidth, graphHeight, g_gpuMsHistory, g_hudGraphFrames, oldest, maxMs, budgetMs,
+                 Hud::rgba(90, 160, 255), over);
+    y += graphHeight + 6;
+
+    hudLine(x, y, white, "DRAWS %d  TRIS %.1fK", g_renderStats.drawCalls, g_renderStats.triangles / 1000.0);
+    hudLine(x, y, white, "BINDS SKIPPED %d", g_glState.skipped());
+    hudLine(x, y, white, "UPLOAD %.1f KB", g_renderStats.uploadBytes / 1024.0);
+    hudLine(x, y, white, "CULL %d TESTED %d CULLED", g_cullStats.tested, g_cullStats.culled);
+    hudLine(x, y, white, "     %d DRAWN", g_cullStats.drawn);
+    if (occlusion)
+        hudLine(x, y, white, "OCCLUSION %d QUERIED %d HIDDEN", g_occlusionCuller->stats.queried, g_occlusionCuller->stats.occluded);
+    if (g_eyeInCell)
+        hudLine(x, y, white, "PORTALS %d CELLS %d/%d PASSED", g_portalStats.cellsVisited,
+                g_portalStats.portalsPassed, g_portalStats.portalsTested);
+
+    g_hud->draw(g_glState);
+}
+
+// The render phase of a frame; the frame loop swaps after it
+static void render() {
+    PROFILE_SCOPE("render");
+    g_gpuProfiler->beginFrame();
+    g_glState.beginFrame();
+    g_renderStats = RenderStats();
+    g_glState.useProgram(g_shaderStates[g_activeShader].program);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);                   // clear framebuffer color&depth
 
+    if (g_staticBatch)
+        g_staticBatch->beginFrame();
     drawStuff();
+    if (g_staticBatch)
+        g_staticBatch->endFrame();
 
-    glutSwapBuffers();    // show the back buffer (where we rendered stuff)
+    if (g_agentRenderer) {
+        GpuPass pass(*g_gpuProfiler, "agents");
+        drawAgents((1 - g_tickAccumulator / g_tickSeconds) * g_tickSeconds);
+        g_glState.useProgram(g_shaderStates[g_activeShader].program);
+    }
+
+    if (g_hud && g_showHud) {
+        GpuPass pass(*g_gpuProfiler, "hud");
+        drawHud();
+    }
+    g_gpuProfiler->endFrame();
 
     checkGlErrors();
 }
 
+// Every frame is drawn by the frame loop, so window exposure needs nothing
+static void display() {}
+
 
 static void reshape(const int w, const int h) {
     g_windowWidth = w;
@@ -463,35 +2097,13 @@ static void reshape(const int w, const int h) {
 
 
 static void motion(const int x, const int y) {
-    // 콺  ȭ 
-    const double dx = x - g_windowWidth / 2;
-    const double dy = g_windowHeight / 2 - y; // OpenGL Y ǥ  
-
-    // Yaw Pitch Ʈ
-    g_yaw += -dx * 0.2;  // ¿ ȸ
-    g_pitch += dy * 0.2; //  ȸ
-
-    // Pitch : -90 ~ 90
-    if (g_pitch > 89.0) g_pitch = 89.0;
-    if (g_pitch < -89.0) g_pitch = -89.0;
-
-    // ο   
-    Matrix4 yawRotation = Matrix4::makeYRotation(g_yaw);
-    Matrix4 pitchRotation = Matrix4::makeXRotation(g_pitch);
-
-    //  ġ  
-    Cvec3 currentTranslation = Cvec3(g_skyRbt(0, 3), g_skyRbt(1, 3), g_skyRbt(2, 3));
-
-    // ο ȯ  
-    g_skyRbt = yawRotation * pitchRotation;
-    g_skyRbt(0, 3) = currentTranslation[0];
-    g_skyRbt(1, 3) = currentTranslation[1];
-    g_skyRbt(2, 3) = currentTranslation[2];
+    // 콺  ȭ ,  tick ȸ ݿ
+    g_mouseDx += x - g_windowWidth / 2;
+    g_mouseDy += g_windowHeight / 2 - y; // OpenGL Y ǥ  
 
     // 콺 Ŀ â ߾ ̵
-    glutWarpPointer(g_windowWidth / 2, g_windowHeight / 2);
-
-    glutPostRedisplay(); // ȭ 
+    if (x != g_windowWidth / 2 || y != g_windowHeight / 2)
+        glutWarpPointer(g_windowWidth / 2, g_windowHeight / 2);
 }
 
 
@@ -530,82 +2142,87 @@ static void mouse(const int button, const int state, const int x, const int y) {
 }
 
 
-static void keyboard(const unsigned char key, const int x, const int y) {
-    const double moveAmount = 0.2;// ̵ ũ
-    const double rotateAmount = 5.0; // ȸ  ( )
-
-    // 9 plane   Relative Y Position Ȯ
-    auto canMoveTo = [&](const Matrix4& proposedRbt) -> bool {
-        // ӽ÷ g_skyRbt ƮϿ 
-        Matrix4 originalRbt = g_skyRbt;
-        g_skyRbt = proposedRbt;
-
-        vector<Matrix4> planeTransforms;
-
-        // 1
-        createStructure(*g_shaderStates[g_activeShader], Matrix4::makeTranslation(Cvec3(0.0, 0.0, 0.0)), planeTransforms);
-        // 2
-        createStructure(*g_shaderStates[g_activeShader], Matrix4::makeTranslation(Cvec3(0.0, 0.0, 0.0)) * Matrix4::makeYRotation(-90), planeTransforms);
-        // 3
-        createStructure(*g_shaderStates[g_activeShader], Matrix4::makeTranslation(Cvec3(0.0, 0.0, 0.0)) * Matrix4::makeYRotation(90), planeTransforms);
-
-        vector<double> relativeYPositions = checkViewPositionRelativeToPlanes(planeTransforms);
-
-        g_skyRbt = originalRbt; //  Rbt 
+// Moves the eye from from by d, sliding along the walls of the scene and of
+// the world tile it is in. Returns the position reached.
+static Cvec3 moveEye(const Cvec3& from, const Cvec3& d) {
+    PROFILE_SCOPE("moveEye");
+    const WorldTile* tile = g_world ? g_world->find(g_world->tileAt(from)) : NULL;
+    return slideSphere(from, d, g_eyeRadius, [tile](const Cvec3& p, const Cvec3& d, double r, SweepHit& hit) {
+        bool found = g_walls.sweep(p, d, r, hit);
+        if (tile && tile->colliders.sweep(p, d, r, hit))
+            found = true;
+        return found;
+    });
+}
 
-        //    Yǥ  Ȯ
-        // 2, 5, 8  Yǥ  üũ
-        if (relativeYPositions[1] <= 2 || relativeYPositions[4] <= 2 || relativeYPositions[7] <= 2) {
-            return false; // 2, 5, Ǵ 8  Yǥ  ̵ Ұ
-        }
+// One tick of the simulation: applies the input recorded since the last tick
+// to the eye, then steps the agents
+static void simulate(double dt) {
+    PROFILE_SCOPE("simulate");
+    g_prevEye = g_eye;
+
+    // Yaw Pitch Ʈ, Pitch : -89 ~ 89
+    g_eye.yaw -= g_mouseDx * g_mouseDegreesPerPixel;
+    g_eye.pitch = max(-89.0, min(g_eye.pitch + g_mouseDy * g_mouseDegreesPerPixel, 89.0));
+    g_mouseDx = g_mouseDy = 0;
+
+    // ̵ :  ε   ̲
+    const Cvec3 local(g_keyDown['d'] - g_keyDown['a'], 0, g_keyDown['s'] - g_keyDown['w']);
+    if (dot(local, local) > 0) {
+        const Matrix4 rotation = Matrix4::makeYRotation(g_eye.yaw) * Matrix4::makeXRotation(g_eye.pitch);
+        const Cvec3 d(rotation * Cvec4(normalize(local) * (g_moveSpeed * dt), 0));
+        g_eye.position = moveEye(g_eye.position, d);
+    }
 
-        // ߰  
-        if (relativeYPositions[1] < 10.5) {
-            // 2  Yǥ 10.5  1 3  üũ
-            if (relativeYPositions[0] <= 0.5 || relativeYPositions[2] <= 0.5) {
-                return false; // 1 Ǵ 3  Yǥ  ̵ Ұ
-            }
-        }
-        else if (relativeYPositions[1] > 14.5) {
-            // 2  Ÿ 14.5 ũ 1 3  üũ
-            if (relativeYPositions[0] <= 0.5 || relativeYPositions[2] <= 0.5) {
-                return false; // 1 Ǵ 3  Yǥ  ̵ Ұ
-            }
-        }
-        else {
-            // 2  Yǥ 10.5 ̻ 14.5   7 9  üũ
-            if (relativeYPositions[6] <= 0.5 || relativeYPositions[8] <= 0.5) {
-                return false; // 7 Ǵ 9  Yǥ  ̵ Ұ
-            }
-        }
+    if (g_agents) {
+        const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        g_agents->step(dt, g_walls, *g_jobs);
+        g_agentStepMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    }
+}
 
-        return true;
-    };
+// The update phase of a frame: runs the ticks owed for the time since the
+// last frame, leaving less than a tick for the frame to interpolate over
+static void update() {
+    PROFILE_SCOPE("update");
+    const chrono::steady_clock::time_point now = chrono::steady_clock::now();
+    if (!g_firstFrame)
+        g_tickAccumulator += chrono::duration<double>(now - g_lastFrameTime).count();
+    g_lastFrameTime = now;
+    g_firstFrame = false;
+
+    int ticks = 0;
+    while (g_tickAccumulator >= g_tickSeconds && ticks < g_maxTicksPerFrame) {
+        simulate(g_tickSeconds);
+        g_tickAccumulator -= g_tickSeconds;
+        ++ticks;
+    }
+    g_tickAccumulator = min(g_tickAccumulator, g_tickSeconds);
+}
 
-    // ̵ 
-    auto tryMove = [&](const Matrix4& movement) {
-        Matrix4 proposedRbt = g_skyRbt * movement;
-        if (canMoveTo(proposedRbt)) {
-            g_skyRbt = proposedRbt;
-        }
-        else {
-            cout << "Movement blocked: Camera does not meet movement conditions." << endl;
-        }
-    };
+static void keyboard(const unsigned char key, const int x, const int y) {
+    g_keyDown[key] = true;
 
     switch (key) {
     case 27: // ESC
-        exit(0);
+        g_frameLoop.stop();
+        break;
 
     case 'h': //  
         cout << " ============== H E L P ==============\n\n"
             << "h\t\thelp menu\n"
             << "s\t\tsave screenshot\n"
             << "f\t\tToggle flat shading on/off.\n"
-            << "w\t\tMove camera -z (zoom in)\n"
-            << "s\t\tMove camera +z (zoom out)\n"
-            << "d\t\tRotate camera head to left\n"
-            << "a\t\tRotate camera head to right\n"
+            << "b\t\tToggle batched static scene (multi-draw indirect) on/off\n"
+            << "c\t\tToggle view frustum culling on/off\n"
+            << "o\t\tToggle occlusion culling on/off\n"
+            << "p\t\tToggle portal culling inside the corridors on/off\n"
+            << "i\t\tPrint culling and frame timing statistics\n"
+            << "v\t\tToggle the performance overlay on/off\n"
+            << "w\t\tHold to move camera forward\n"
+            << "s\t\tHold to move camera backward\n"
+            << "d\t\tHold to move camera right\n"
+            << "a\t\tHold to move camera left\n"
             << "drag left mouse to rotate\n" << endl;
         break;
 
@@ -613,24 +2230,58 @@ static void keyboard(const unsigned char key, const int x, const int y) {
         g_activeShader ^= 1;
         break;
 
-    case 'w': // -z ̵ (Ȯ)
-        tryMove(Matrix4::makeTranslation(Cvec3(0, 0, -moveAmount)));
+    case 'c':
+        g_frustumCulling = !g_frustumCulling;
+        cout << "Frustum culling: " << (g_frustumCulling ? "on" : "off") << endl;
+        break;
+
+    case 'o':
+        g_occlusionCulling = !g_occlusionCulling;
+        cout << "Occlusion culling: " << (g_occlusionCuller && g_occlusionCulling ? "on" : "off") << endl;
+        break;
+
+    case 'p':
+        g_portalCulling = !g_portalCulling;
+        cout << "Portal culling: " << (g_portalCulling ? "on" : "off")
+            << (g_sceneCells.empty() ? " (the scene declares no cells)" : "") << endl;
         break;
 
-    case 's': // +z ̵ ()
-        tryMove(Matrix4::makeTranslation(Cvec3(0, 0, moveAmount)));
+    case 'i':
+        if (g_eyeInCell)
+            cout << "Portals: " << g_portalStats.cellsVisited << " cells visited, "
+                << g_portalStats.portalsPassed << " of " << g_portalStats.portalsTested << " portals passed" << endl;
+        cout << "Triangles: " << g_drawnTriangles << endl;
+        cout << "Culling: " << g_cullStats.tested << " tested, " << g_cullStats.culled << " culled, "
+            << g_cullStats.drawn << " drawn" << endl;
+        if (g_occlusionCuller && g_occlusionCulling)
+            cout << "Occlusion: " << g_occlusionCuller->stats.occluders << " occluders, "
+                << g_occlusionCuller->stats.queried << " queried, "
+                << g_occlusionCuller->stats.occluded << " occluded" << endl;
+        if (g_world)
+            cout << "World: " << g_world->numResident() << " tiles, " << g_world->residentBytes() << " bytes" << endl;
+        g_frameLoop.printStats(cout);
+        g_gpuProfiler->printStats(cout);
+        cout << "Draws: " << g_renderStats.drawCalls << ", " << g_renderStats.triangles << " triangles, "
+            << g_glState.skipped() << " binds skipped, " << g_renderStats.uploadBytes << " bytes uploaded" << endl;
+        if (g_agents)
+            cout << "Agents: " << g_agents->size() << ", stepped in " << g_agentStepMs << " ms on "
+                << g_jobs->numThreads() << " threads" << endl;
         break;
 
-    case 'd': // ī޶  ȸ
-        tryMove(Matrix4::makeTranslation(Cvec3(moveAmount, 0, 0)));
+    case 'v':
+        g_showHud = !g_showHud;
+        cout << "Performance overlay: " << (g_hud && g_showHud ? "on" : "off") << endl;
         break;
 
-    case 'a': // ī޶  ȸ
-        tryMove(Matrix4::makeTranslation(Cvec3(-moveAmount, 0, 0)));
+    case 'b':
+        g_useStaticBatch = !g_useStaticBatch;
+        cout << "Static batching: " << (g_staticBatch && g_useStaticBatch ? (g_staticBatch->multiDrawIndirect ? "multi-draw indirect" : "per-node fallback") : "off") << endl;
         break;
     }
+}
 
-    glutPostRedisplay();
+static void keyboardUp(const unsigned char key, const int x, const int y) {
+    g_keyDown[key] = false;
 }
 
 
@@ -646,6 +2297,8 @@ static void initGlutState(int argc, char* argv[]) {
     glutReshapeFunc(reshape);                               // window reshape callback
     glutMouseFunc(mouse);                                   // mouse click callback
     glutKeyboardFunc(keyboard);
+    glutKeyboardUpFunc(keyboardUp);
+    glutIgnoreKeyRepeat(1);                                 // w/a/s/d are held, not repeated
     glutPassiveMotionFunc(motion);
 
 }
@@ -666,29 +2319,76 @@ static void initGLState() {
 }
 
 static void initShaders() {
-    g_shaderStates.resize(g_numShaders);
+    g_shaderStates.reserve(g_numShaders);
     for (int i = 0; i < g_numShaders; ++i) {
         if (g_Gl2Compatible)
-            g_shaderStates[i].reset(new ShaderState(g_shaderFilesGl2[i][0], g_shaderFilesGl2[i][1]));
+            g_shaderStates.push_back(ShaderState(g_shaderFilesGl2[i][0], g_shaderFilesGl2[i][1]));
         else
-            g_shaderStates[i].reset(new ShaderState(g_shaderFiles[i][0], g_shaderFiles[i][1]));
+            g_shaderStates.push_back(ShaderState(g_shaderFiles[i][0], g_shaderFiles[i][1]));
+    }
+
+    if (staticBatchSupported()) {
+        g_sceneShaderStates.reserve(g_numShaders);
+        for (int i = 0; i < g_numShaders; ++i)
+            g_sceneShaderStates.push_back(SceneShaderState(g_sceneShaderFiles[i][0], g_sceneShaderFiles[i][1]));
+    }
+
+    if (agentRenderingSupported()) {
+        g_agentShaderStates.reserve(g_numShaders);
+        for (int i = 0; i < g_numShaders; ++i)
+            g_agentShaderStates.push_back(AgentShaderState(g_agentShaderFiles[i][0], g_agentShaderFiles[i][1]));
     }
 }
 
 
 static void initTextures() {
-    loadTexture("wall.ppm", wallTextureID);
+    loadTexture(g_textureFile.c_str(), wallTextureID);
     glBindTexture(GL_TEXTURE_2D, wallTextureID);
 }
 
 
 static void initGeometry() {
-    initGround();
+    initScene();
+    g_gpuProfiler.reset(new GpuProfiler());
+    if (!g_Gl2Compatible)
+        g_hud.reset(new Hud(g_hudShaderFiles[0], g_hudShaderFiles[1]));
     initTextures(); // ؽó ʱȭ ߰
 }
 
 int main(int argc, char* argv[]) {
     try {
+        const char* exportFile = NULL;
+        for (int i = 1; i + 1 < argc; ++i) {
+            if (strcmp(argv[i], "--export-scene") == 0)
+                exportFile = argv[++i];
+            else if (strcmp(argv[i], "--scene") == 0)
+                g_sceneFile = argv[++i];
+            else if (strcmp(argv[i], "--verify-scene") == 0) {
+                g_sceneFile = argv[++i];
+                g_verifyScene = true;
+            }
+            else if (strcmp(argv[i], "--import") == 0)
+                g_importFile = argv[++i];
+            else if (strcmp(argv[i], "--maze") == 0) {
+                if (sscanf(argv[++i], "%dx%d", &g_mazeWidth, &g_mazeDepth) != 2)
+                    g_mazeDepth = g_mazeWidth = atoi(argv[i]);
+            }
+            else if (strcmp(argv[i], "--seed") == 0)
+                g_mazeSeed = strtoull(argv[++i], NULL, 10);
+            else if (strcmp(argv[i], "--pacing") == 0)
+                g_pacing = FrameLoop::parsePacing(argv[++i], g_pacingRate);
+            else if (strcmp(argv[i], "--trace") == 0)
+                g_traceFile = argv[++i];
+            else if (strcmp(argv[i], "--agents") == 0)
+                g_numAgents = max(atoi(argv[++i]), 0);
+            else if (strcmp(argv[i], "--world") == 0)
+                g_worldBudget = static_cast<size_t>(max(atoi(argv[++i]), 1)) << 20;
+        }
+        if (exportFile) {
+            exportScene(exportFile);
+            return 0;
+        }
+
         initGlutState(argc, argv);
 
         glewInit(); // load the OpenGL extensions
@@ -703,7 +2403,19 @@ int main(int argc, char* argv[]) {
         initShaders();
         initGeometry();
 
-        glutMainLoop();
+        FramePhases phases;
+        phases.update = update;
+        phases.cull = cull;
+        phases.render = render;
+        g_frameLoop.setPacing(g_pacing, g_pacingRate);
+        g_frameLoop.run(phases);
+
+#ifdef ENABLE_PROFILER
+        g_world.reset();    // the streaming thread records too, stop it before reading the rings
+        profilerWriteChromeTrace(g_traceFile);
+        cout << "Trace written to " << g_traceFile << endl;
+        profilerPrintSummary(cout);
+#endif
         return 0;
     }
     catch (const runtime_error& e) {
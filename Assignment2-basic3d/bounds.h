@@ -0,0 +1,283 @@
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include <algorithm>
+#include <vector>
+
+#include "cvec.h"
+#include "matrix4.h"
+
+//--------------------------------------------------------------------------------
+// Bounding volumes, view frustum and a bounding-volume hierarchy for culling
+//--------------------------------------------------------------------------------
+
+
+// Axis aligned bounding box. A default constructed box is empty, and grows
+// to contain whatever is added to it.
+struct Aabb {
+  Cvec3 lo, hi;
+
+  Aabb() : lo(1e30), hi(-1e30) {}
+  Aabb(const Cvec3& lo, const Cvec3& hi) : lo(lo), hi(hi) {}
+
+  bool isEmpty() const {
+    return lo[0] > hi[0];
+  }
+
+  Aabb& add(const Cvec3& p) {
+    for (int i = 0; i < 3; ++i) {
+      lo[i] = std::min(lo[i], p[i]);
+      hi[i] = std::max(hi[i], p[i]);
+    }
+    return *this;
+  }
+
+  Aabb& add(const Aabb& b) {
+    if (!b.isEmpty()) {
+      add(b.lo);
+      add(b.hi);
+    }
+    return *this;
+  }
+
+  Cvec3 center() const {
+    return (lo + hi) * 0.5;
+  }
+
+  Cvec3 halfExtent() const {
+    return (hi - lo) * 0.5;
+  }
+};
+
+// Returns the axis aligned box containing the box b transformed by the affine
+// matrix m (Arvo's method: each row of m is applied to the box extents)
+inline Aabb transformAabb(const Matrix4& m, const Aabb& b) {
+  if (b.isEmpty())
+    return b;
+  const Cvec3 c = b.center(), e = b.halfExtent();
+  Cvec3 tc, te;
+  for (int i = 0; i < 3; ++i) {
+    tc[i] = m(i,3);
+    for (int j = 0; j < 3; ++j) {
+      tc[i] += m(i,j) * c[j];
+      te[i] += std::abs(m(i,j)) * e[j];
+    }
+  }
+  return Aabb(tc - te, tc + te);
+}
+
+// Bounding sphere, cheaper to test than a box and used as a first rejection
+struct BoundingSphere {
+  Cvec3 center;
+  double radius;
+
+  BoundingSphere() : radius(0) {}
+  BoundingSphere(const Cvec3& c, double r) : center(c), radius(r) {}
+
+  // The sphere circumscribing a box
+  explicit BoundingSphere(const Aabb& b) : center(b.center()), radius(norm(b.halfExtent())) {}
+};
+
+enum CullResult {
+  CULL_OUTSIDE,
+  CULL_INTERSECT,
+  CULL_INSIDE
+};
+
+// The six planes of a view frustum in world space. A point p is inside when
+// dot(plane, (p, 1)) >= 0 for all six planes.
+struct Frustum {
+  static const int MAX_PLANES = 16;
+
+  Cvec4 planes[MAX_PLANES];
+  int numPlanes;
+
+  Frustum() : numPlanes(0) {}
+
+  // Extracts the planes from a projection * view matrix (Gribb & Hartmann):
+  // -w <= x,y,z <= w in clip space gives row3 +- row0,1,2
+  explicit Frustum(const Matrix4& projView) : numPlanes(6) {
+    for (int i = 0; i < 3; ++i) {
+      for (int j = 0; j < 4; ++j) {
+        planes[2*i][j] = projView(3,j) + projView(i,j);
+        planes[2*i+1][j] = projView(3,j) - projView(i,j);
+      }
+    }
+    for (int i = 0; i < numPlanes; ++i) {
+      planes[i] /= norm(Cvec3(planes[i]));
+    }
+  }
+
+  void addPlane(const Cvec4& plane) {
+    assert(numPlanes < MAX_PLANES);
+    planes[numPlanes++] = plane;
+  }
+
+  static double distance(const Cvec4& plane, const Cvec3& p) {
+    return plane[0] * p[0] + plane[1] * p[1] + plane[2] * p[2] + plane[3];
+  }
+
+  CullResult classify(const BoundingSphere& s) const {
+    CullResult r = CULL_INSIDE;
+    for (int i = 0; i < numPlanes; ++i) {
+      const double d = distance(planes[i], s.center);
+      if (d < -s.radius)
+        return CULL_OUTSIDE;
+      if (d < s.radius)
+        r = CULL_INTERSECT;
+    }
+    return r;
+  }
+
+  // Tests the corner furthest along each plane normal (p-vertex) for rejection,
+  // and the nearest one (n-vertex) for full containment
+  CullResult classify(const Aabb& b) const {
+    CullResult r = CULL_INSIDE;
+    for (int i = 0; i < numPlanes; ++i) {
+      const Cvec4& pl = planes[i];
+      Cvec3 pv, nv;
+      for (int k = 0; k < 3; ++k) {
+        pv[k] = pl[k] >= 0 ? b.hi[k] : b.lo[k];
+        nv[k] = pl[k] >= 0 ? b.lo[k] : b.hi[k];
+      }
+      if (distance(pl, pv) < 0)
+        return CULL_OUTSIDE;
+      if (distance(pl, nv) < 0)
+        r = CULL_INTERSECT;
+    }
+    return r;
+  }
+};
+
+// Counters of one culling pass
+struct CullStats {
+  int tested;   // bounding volume tests performed
+  int culled;   // objects rejected
+  int drawn;    // objects accepted
+
+  CullStats() : tested(0), culled(0), drawn(0) {}
+};
+
+// Bounding volume hierarchy over a static set of objects, given by their world
+// space boxes. Built once by median splits along the longest axis, then culled
+// top-down: subtrees fully outside are rejected and subtrees fully inside are
+// accepted without testing anything below them.
+class Bvh {
+  struct Node {
+    Aabb box;
+    BoundingSphere sphere;
+    int left, right;     // children, -1 for leaves
+    int first, count;    // range in items_ covered by this subtree
+  };
+
+  std::vector<Node> nodes_;
+  std::vector<int> items_;   // object indices, grouped by leaf
+  std::vector<Aabb> boxes_;  // world box of every object
+  int leafSize_;
+
+  int build(int first, int count) {
+    Node node;
+    node.first = first;
+    node.count = count;
+    node.left = node.right = -1;
+    Aabb centers;
+    for (int i = first; i < first + count; ++i) {
+      node.box.add(boxes_[items_[i]]);
+      centers.add(boxes_[items_[i]].center());
+    }
+    node.sphere = BoundingSphere(node.box);
+
+    const int self = static_cast<int>(nodes_.size());
+    nodes_.push_back(node);
+    if (count <= leafSize_)
+      return self;
+
+    const Cvec3 ext = centers.hi - centers.lo;
+    const int axis = ext[0] > ext[1] ? (ext[0] > ext[2] ? 0 : 2) : (ext[1] > ext[2] ? 1 : 2);
+    const int half = count / 2;
+    const std::vector<Aabb>& boxes = boxes_;
+    std::nth_element(items_.begin() + first, items_.begin() + first + half, items_.begin() + first + count,
+                     [&boxes, axis](int a, int b) {
+                       return boxes[a].lo[axis] + boxes[a].hi[axis] < boxes[b].lo[axis] + boxes[b].hi[axis];
+                     });
+
+    const int left = build(first, half);
+    const int right = build(first + half, count - half);
+    nodes_[self].left = left;
+    nodes_[self].right = right;
+    return self;
+  }
+
+  void acceptAll(const Node& node, std::vector<int>& visible, CullStats& stats) const {
+    visible.insert(visible.end(), items_.begin() + node.first, items_.begin() + node.first + node.count);
+    stats.drawn += node.count;
+  }
+
+  void cull(int n, const Frustum& f, std::vector<int>& visible, CullStats& stats) const {
+    const Node& node = nodes_[n];
+    ++stats.tested;
+    CullResult r = f.classify(node.sphere);
+    if (r == CULL_INTERSECT)
+      r = f.classify(node.box);
+
+    if (r == CULL_OUTSIDE) {
+      stats.culled += node.count;
+    }
+    else if (r == CULL_INSIDE) {
+      acceptAll(node, visible, stats);
+    }
+    else if (node.left < 0) {
+      // Partially visible leaf: test its objects one by one
+      for (int i = node.first; i < node.first + node.count; ++i) {
+        ++stats.tested;
+        if (f.classify(boxes_[items_[i]]) == CULL_OUTSIDE) {
+          ++stats.culled;
+        }
+        else {
+          visible.push_back(items_[i]);
+          ++stats.drawn;
+        }
+      }
+    }
+    else {
+      cull(node.left, f, visible, stats);
+      cull(node.right, f, visible, stats);
+    }
+  }
+
+public:
+  explicit Bvh(int leafSize = 4) : leafSize_(leafSize) {}
+
+  void build(const std::vector<Aabb>& boxes) {
+    std::vector<int> objects(boxes.size());
+    for (size_t i = 0; i < boxes.size(); ++i) {
+      objects[i] = static_cast<int>(i);
+    }
+    build(boxes, objects);
+  }
+
+  // Builds over only the listed objects; cull still reports indices into boxes
+  void build(const std::vector<Aabb>& boxes, const std::vector<int>& objects) {
+    boxes_ = boxes;
+    nodes_.clear();
+    items_ = objects;
+    if (!items_.empty())
+      build(0, static_cast<int>(items_.size()));
+  }
+
+  // Appends to visible the indices of the objects intersecting f
+  void cull(const Frustum& f, std::vector<int>& visible, CullStats& stats) const {
+    if (!nodes_.empty())
+      cull(0, f, visible, stats);
+  }
+
+  const Aabb& box(int i) const {
+    return boxes_[i];
+  }
+
+  int numObjects() const {
+    return static_cast<int>(boxes_.size());
+  }
+};
+
+#endif
@@ -0,0 +1,165 @@
+#ifndef BROADPHASE_H
+#define BROADPHASE_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "bounds.h"
+
+//--------------------------------------------------------------------------------
+// Uniform grid broad phase over the xz footprints of boxes
+//--------------------------------------------------------------------------------
+
+
+// Buckets every box into the square cells of a grid on the xz plane that its
+// footprint overlaps. Only occupied cells are stored, in an open addressing
+// hash table of ranges into one flat item array, so the grid may be
+// unbounded. A query visits just the cells its box overlaps, which keeps its
+// cost flat in the number of boxes as long as the cells stay about as large
+// as the boxes. Queries are const and may run concurrently.
+class SpatialHash {
+  struct Bucket {
+    int cx, cz;
+    unsigned first, count;   // count == 0 for an empty slot
+  };
+
+  double cellSize_, invCellSize_;
+  std::vector<Aabb> boxes_;
+  std::vector<int> minCell_;           // first cell x and z of every box
+  std::vector<Bucket> buckets_;
+  std::vector<int> items_;
+
+  static unsigned hash(int cx, int cz) {
+    unsigned h = static_cast<unsigned>(cx) * 0x8da6b343u ^ static_cast<unsigned>(cz) * 0xd8163841u;
+    return h ^ (h >> 16);
+  }
+
+  int cellOf(double x) const {
+    return static_cast<int>(std::max(std::min(std::floor(x * invCellSize_), 1e9), -1e9));
+  }
+
+  static bool overlaps(const Aabb& a, const Aabb& b) {
+    return a.lo[0] <= b.hi[0] && a.hi[0] >= b.lo[0] && a.lo[1] <= b.hi[1] && a.hi[1] >= b.lo[1] &&
+      a.lo[2] <= b.hi[2] && a.hi[2] >= b.lo[2];
+  }
+
+  const Bucket* find(int cx, int cz) const {
+    const unsigned mask = static_cast<unsigned>(buckets_.size()) - 1;
+    for (unsigned i = hash(cx, cz) & mask;; i = (i + 1) & mask) {
+      const Bucket& b = buckets_[i];
+      if (b.count == 0)
+        return NULL;
+      if (b.cx == cx && b.cz == cz)
+        return &b;
+    }
+  }
+
+public:
+  SpatialHash() : cellSize_(1), invCellSize_(1) {}
+
+  int size() const {
+    return static_cast<int>(boxes_.size());
+  }
+
+  double cellSize() const {
+    return cellSize_;
+  }
+
+  // Rebuilds the grid over boxes with cells of cellSize, or of the mean
+  // footprint size of the boxes if 0
+  void build(const std::vector<Aabb>& boxes, double cellSize = 0) {
+    boxes_ = boxes;
+    if (cellSize <= 0) {
+      double sum = 0;
+      for (size_t i = 0; i < boxes.size(); ++i)
+        sum += std::max(boxes[i].hi[0] - boxes[i].lo[0], boxes[i].hi[2] - boxes[i].lo[2]);
+      cellSize = boxes.empty() ? 1 : sum / boxes.size();
+    }
+    cellSize_ = std::max(cellSize, 1e-3);
+    invCellSize_ = 1 / cellSize_;
+
+    // (cell, box) pairs sorted by cell
+    struct Entry {
+      int cx, cz, item;
+
+      bool operator < (const Entry& e) const {
+        return cx < e.cx || (cx == e.cx && (cz < e.cz || (cz == e.cz && item < e.item)));
+      }
+    };
+    std::vector<Entry> entries;
+    minCell_.resize(2 * boxes.size());
+    for (int i = 0; i < size(); ++i) {
+      const int x0 = cellOf(boxes[i].lo[0]), x1 = cellOf(boxes[i].hi[0]);
+      const int z0 = cellOf(boxes[i].lo[2]), z1 = cellOf(boxes[i].hi[2]);
+      minCell_[2 * i] = x0;
+      minCell_[2 * i + 1] = z0;
+      for (int cx = x0; cx <= x1; ++cx) {
+        for (int cz = z0; cz <= z1; ++cz) {
+          const Entry e = { cx, cz, i };
+          entries.push_back(e);
+        }
+      }
+    }
+    std::sort(entries.begin(), entries.end());
+
+    size_t numCells = 0;
+    for (size_t i = 0; i < entries.size(); ++i)
+      numCells += i == 0 || entries[i].cx != entries[i - 1].cx || entries[i].cz != entries[i - 1].cz;
+    size_t capacity = 16;
+    while (capacity < 2 * numCells)
+      capacity *= 2;
+    const Bucket empty = { 0, 0, 0, 0 };
+    buckets_.assign(capacity, empty);
+
+    items_.resize(entries.size());
+    for (size_t i = 0; i < entries.size();) {
+      Bucket b = { entries[i].cx, entries[i].cz, static_cast<unsigned>(i), 0 };
+      for (; i < entries.size() && entries[i].cx == b.cx && entries[i].cz == b.cz; ++i, ++b.count)
+        items_[i] = entries[i].item;
+      const unsigned mask = static_cast<unsigned>(capacity) - 1;
+      unsigned slot = hash(b.cx, b.cz) & mask;
+      while (buckets_[slot].count)
+        slot = (slot + 1) & mask;
+      buckets_[slot] = b;
+    }
+  }
+
+  // Replaces the contents of out with the boxes overlapping box, each once.
+  // out keeps its capacity, so a buffer reused across queries stops
+  // allocating once it has grown to the largest result.
+  void query(const Aabb& box, std::vector<int>& out) const {
+    out.clear();
+    if (boxes_.empty())
+      return;
+    const int x0 = cellOf(box.lo[0]), x1 = cellOf(box.hi[0]);
+    const int z0 = cellOf(box.lo[2]), z1 = cellOf(box.hi[2]);
+
+    // a box larger than the occupied cells is cheaper to test against everything
+    if ((static_cast<double>(x1) - x0 + 1) * (static_cast<double>(z1) - z0 + 1) > static_cast<double>(buckets_.size())) {
+      for (int i = 0; i < size(); ++i) {
+        if (overlaps(boxes_[i], box))
+          out.push_back(i);
+      }
+      return;
+    }
+
+    for (int cx = x0; cx <= x1; ++cx) {
+      for (int cz = z0; cz <= z1; ++cz) {
+        const Bucket* b = find(cx, cz);
+        if (!b)
+          continue;
+        for (unsigned k = b->first; k < b->first + b->count; ++k) {
+          const int i = items_[k];
+          // a box spanning several visited cells is reported by the first of them
+          if (cx != std::max(x0, minCell_[2 * i]) || cz != std::max(z0, minCell_[2 * i + 1]))
+            continue;
+          if (overlaps(boxes_[i], box))
+            out.push_back(i);
+        }
+      }
+    }
+  }
+};
+
+#endif
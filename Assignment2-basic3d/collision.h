@@ -0,0 +1,273 @@
+#ifndef COLLISION_H
+#define COLLISION_H
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+#include "cvec.h"
+#include "matrix4.h"
+#include "bounds.h"
+#include "broadphase.h"
+
+//--------------------------------------------------------------------------------
+// Continuous collision of moving spheres against finite wall rectangles
+//--------------------------------------------------------------------------------
+
+
+// A wall rectangle: its center, unit axes u and v in its plane with the half
+// extents along them, and its unit normal
+struct WallRect {
+  Cvec3 center, u, v, normal;
+  double halfU, halfV;
+
+  WallRect() : halfU(0), halfV(0) {}
+
+  // The flat box of a plane mesh in its xz plane, e.g., made by
+  // createTexturedPlane, placed by the rigid body transform rbt
+  WallRect(const Matrix4& rbt, const Aabb& box) {
+    const Cvec3 c = box.center(), e = box.halfExtent();
+    const Cvec3 x(rbt(0,0), rbt(1,0), rbt(2,0)), y(rbt(0,1), rbt(1,1), rbt(2,1)), z(rbt(0,2), rbt(1,2), rbt(2,2));
+    center = Cvec3(rbt(0,3), rbt(1,3), rbt(2,3)) + x * c[0] + y * c[1] + z * c[2];
+    u = normalize(x);
+    v = normalize(z);
+    normal = normalize(cross(v, u));
+    halfU = e[0];
+    halfV = e[2];
+  }
+
+  Aabb bounds() const {
+    Cvec3 e;
+    for (int k = 0; k < 3; ++k)
+      e[k] = std::abs(u[k]) * halfU + std::abs(v[k]) * halfV;
+    return Aabb(center - e, center + e);
+  }
+
+  Cvec3 closestPoint(const Cvec3& p) const {
+    const Cvec3 d = p - center;
+    return center + u * std::max(-halfU, std::min(dot(d, u), halfU)) + v * std::max(-halfV, std::min(dot(d, v), halfV));
+  }
+};
+
+// The primitives below look for the first time t in [0, t) at which a sphere
+// of radius r moving from p along p + t * d touches something, and lower t to
+// it if there is one. A sphere already touching counts at t = 0 only while it
+// moves further in, so that it can always back out.
+
+// Against the point c
+inline bool sweepSpherePoint(const Cvec3& p, const Cvec3& d, double r, const Cvec3& c, double& t) {
+  const Cvec3 m = p - c;
+  const double b = dot(m, d), k = dot(m, m) - r * r;
+  if (b >= 0)
+    return false;
+  if (k <= 0) {
+    t = 0;
+    return true;
+  }
+  const double a = dot(d, d), disc = b * b - a * k;
+  if (disc < 0)
+    return false;
+  const double s = (-b - std::sqrt(disc)) / a;
+  if (s >= t)
+    return false;
+  t = s;
+  return true;
+}
+
+// Against the open segment from a to b; its ends are left to sweepSpherePoint
+inline bool sweepSphereSegment(const Cvec3& p, const Cvec3& d, double r, const Cvec3& a, const Cvec3& b, double& t) {
+  const Cvec3 e = b - a, m = p - a;
+  const double ee = dot(e, e), md = dot(m, e), nd = dot(d, e);
+
+  // scaled by ee, the squared distance from the axis and its change along d
+  const double qa = ee * dot(d, d) - nd * nd;
+  const double qb = ee * dot(m, d) - nd * md;
+  const double qk = ee * (dot(m, m) - r * r) - md * md;
+  if (qb >= 0 || qa <= 1e-12 * ee)
+    return false;   // moving away from or along the axis
+
+  double s = 0;
+  if (qk > 0) {
+    const double disc = qb * qb - qa * qk;
+    if (disc < 0)
+      return false;
+    s = (-qb - std::sqrt(disc)) / qa;
+  }
+  const double along = md + s * nd;
+  if (s >= t || along < 0 || along > ee)
+    return false;
+  t = s;
+  return true;
+}
+
+// Against the wall w: its two faces, four edges and four corners
+inline bool sweepSphereWall(const Cvec3& p, const Cvec3& d, double r, const WallRect& w, double& t) {
+  bool hit = false;
+
+  // the faces, pushed out by r
+  const double s0 = dot(p - w.center, w.normal), sd = dot(d, w.normal);
+  const double side = s0 >= 0 ? 1 : -1;
+  if (side * sd < 0) {
+    const double s = std::max(0.0, (side * s0 - r) / (-side * sd));
+    if (s < t) {
+      const Cvec3 q = p + d * s - w.center;
+      if (std::abs(dot(q, w.u)) <= w.halfU && std::abs(dot(q, w.v)) <= w.halfV) {
+        t = s;
+        hit = true;
+      }
+    }
+  }
+
+  const Cvec3 du = w.u * w.halfU, dv = w.v * w.halfV;
+  const Cvec3 corners[4] = { w.center - du - dv, w.center + du - dv, w.center + du + dv, w.center - du + dv };
+  for (int i = 0; i < 4; ++i) {
+    hit |= sweepSphereSegment(p, d, r, corners[i], corners[(i + 1) % 4], t);
+    hit |= sweepSpherePoint(p, d, r, corners[i], t);
+  }
+  return hit;
+}
+
+struct SweepHit {
+  double t;       // fraction of the move
+  Cvec3 normal;   // away from the wall at the contact
+  int wall;
+};
+
+// One query of a batch: a sphere moving from from by delta
+struct SphereMove {
+  Cvec3 from, delta;
+  double radius;
+};
+
+// Moves a sphere from p by d and slides it along whatever it hits: the sphere
+// stops a small skin short of the first contact, the rest of the move loses
+// its component into the contact normal, and what is left is swept again. In
+// a crease between two contacts it slides along the crease. sweep(p, d, r,
+// hit) finds the first contact before hit.t as sweepSphereWall does, and
+// fills in hit. Returns the position reached.
+template<typename Sweep>
+Cvec3 slideSphere(const Cvec3& p, const Cvec3& d, double r, const Sweep& sweep, int maxIterations = 4) {
+  static const double SKIN = 1e-4;
+  Cvec3 pos = p, rest = d, lastNormal;
+  for (int i = 0; i < maxIterations; ++i) {
+    const double len = norm(rest);
+    if (len < 1e-9)
+      return pos;
+    SweepHit hit;
+    hit.t = 1;
+    if (!sweep(pos, rest, r, hit))
+      return pos + rest;
+
+    pos += rest * std::max(0.0, hit.t - SKIN / len);
+    rest *= 1 - hit.t;
+    rest -= hit.normal * dot(rest, hit.normal);
+    if (i > 0 && dot(rest, lastNormal) < 0) {
+      const Cvec3 crease = cross(lastNormal, hit.normal);
+      const double c2 = dot(crease, crease);
+      rest = c2 > 1e-12 ? crease * (dot(rest, crease) / c2) : Cvec3();
+    }
+    lastNormal = hit.normal;
+  }
+  return pos;
+}
+
+// A set of static walls the spheres collide with. Call build after adding
+// the walls; sweeps then only test the walls in the grid cells they cross.
+class WallSet {
+  std::vector<WallRect> walls_;
+  std::vector<Aabb> boxes_;
+  SpatialHash grid_;
+
+public:
+  void add(const WallRect& w) {
+    walls_.push_back(w);
+    boxes_.push_back(w.bounds());
+  }
+
+  void build() {
+    grid_.build(boxes_);
+  }
+
+  int size() const {
+    return static_cast<int>(walls_.size());
+  }
+
+  const WallRect& wall(int i) const {
+    return walls_[i];
+  }
+
+  // The first contact of a sphere moving from p by d before hit.t, among the
+  // walls whose boxes overlap the box swept by the sphere. candidates is
+  // scratch space for the broad phase.
+  bool sweep(const Cvec3& p, const Cvec3& d, double r, SweepHit& hit, std::vector<int>& candidates) const {
+    assert(grid_.size() == size());
+    Aabb swept;
+    swept.add(p).add(p + d);
+    const Cvec3 pad(r, r, r);
+    grid_.query(Aabb(swept.lo - pad, swept.hi + pad), candidates);
+
+    int first = -1;
+    for (size_t i = 0; i < candidates.size(); ++i) {
+      if (sweepSphereWall(p, d, r, walls_[candidates[i]], hit.t))
+        first = candidates[i];
+    }
+    if (first < 0)
+      return false;
+    fillHit(p, d, first, hit);
+    return true;
+  }
+
+  // As above with a buffer of the calling thread, allocated once
+  bool sweep(const Cvec3& p, const Cvec3& d, double r, SweepHit& hit) const {
+    static thread_local std::vector<int> candidates;
+    return sweep(p, d, r, hit, candidates);
+  }
+
+  // Whether a sphere at p touches any wall
+  bool touches(const Cvec3& p, double r) const {
+    static thread_local std::vector<int> candidates;
+    const Cvec3 pad(r, r, r);
+    grid_.query(Aabb(p - pad, p + pad), candidates);
+    for (size_t i = 0; i < candidates.size(); ++i) {
+      const Cvec3 d = p - walls_[candidates[i]].closestPoint(p);
+      if (dot(d, d) < r * r)
+        return true;
+    }
+    return false;
+  }
+
+  // Moves a sphere from p by d, sliding along the walls
+  Cvec3 move(const Cvec3& p, const Cvec3& d, double r) const {
+    return slideSphere(p, d, r, [this](const Cvec3& p, const Cvec3& d, double r, SweepHit& hit) {
+      return sweep(p, d, r, hit);
+    });
+  }
+
+  // Moves every sphere of moves[0..n) independently, writing the positions
+  // reached to out. The whole batch shares one broad phase buffer.
+  void move(const SphereMove* moves, int n, Cvec3* out) const {
+    static thread_local std::vector<int> candidates;
+    const auto sweepBatch = [this](const Cvec3& p, const Cvec3& d, double r, SweepHit& hit) {
+      return sweep(p, d, r, hit, candidates);
+    };
+    for (int i = 0; i < n; ++i)
+      out[i] = slideSphere(moves[i].from, moves[i].delta, moves[i].radius, sweepBatch);
+  }
+
+private:
+  void fillHit(const Cvec3& p, const Cvec3& d, int wall, SweepHit& hit) const {
+    const WallRect& w = walls_[wall];
+    const Cvec3 c = p + d * hit.t;
+    Cvec3 n = c - w.closestPoint(c);
+    const double len = norm(n);
+    if (len > 1e-9)
+      n /= len;
+    else
+      n = dot(c - w.center, w.normal) >= 0 ? w.normal : -w.normal;
+    hit.normal = n;
+    hit.wall = wall;
+  }
+};
+
+#endif
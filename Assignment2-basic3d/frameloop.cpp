@@ -0,0 +1,155 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include <GL/glew.h>
+#ifdef _WIN32
+#include <GL/wglew.h>
+#elif !defined(__APPLE__)
+#include <GL/glxew.h>
+#endif
+#include <GL/freeglut.h>   // glutMainLoopEvent
+
+#include "frameloop.h"
+
+using namespace std;
+
+static void setSwapInterval(int interval) {
+#ifdef _WIN32
+  if (WGLEW_EXT_swap_control)
+    wglSwapIntervalEXT(interval);
+  else
+    cerr << "WGL_EXT_swap_control is unsupported, vsync is left to the driver" << endl;
+#elif !defined(__APPLE__)
+  Display* display = glXGetCurrentDisplay();
+  if (GLXEW_EXT_swap_control && display)
+    glXSwapIntervalEXT(display, glXGetCurrentDrawable(), interval);
+  else if (GLXEW_MESA_swap_control)
+    glXSwapIntervalMESA(interval);
+  else
+    cerr << "GLX_EXT_swap_control is unsupported, vsync is left to the driver" << endl;
+#else
+  (void)interval;
+  cerr << "Setting the swap interval is unsupported here, vsync is left to the driver" << endl;
+#endif
+}
+
+FrameLoop::FrameLoop()
+  : pacing_(PACING_VSYNC), period_(0), running_(false), numFrames_(0) {
+  memset(phaseMs_, 0, sizeof(phaseMs_));
+  memset(frameMs_, 0, sizeof(frameMs_));
+}
+
+void FrameLoop::setPacing(FramePacing pacing, double rateHz) {
+  pacing_ = pacing;
+  period_ = chrono::duration_cast<Clock::duration>(chrono::duration<double>(1 / max(rateHz, 1.0)));
+  setSwapInterval(pacing == PACING_VSYNC ? 1 : 0);
+}
+
+void FrameLoop::run(const FramePhases& phases) {
+  glutSetOption(GLUT_ACTION_ON_WINDOW_CLOSE, GLUT_ACTION_GLUTMAINLOOP_RETURNS);
+
+  const function<void()>* const callbacks[NUM_FRAME_PHASES] = {
+    NULL, &phases.update, &phases.cull, &phases.render, NULL, NULL
+  };
+
+  running_ = true;
+  Clock::time_point deadline = Clock::now();
+  while (running_) {
+    const int slot = static_cast<int>(numFrames_ % STATS_FRAMES);
+    const Clock::time_point frameStart = Clock::now();
+    Clock::time_point start = frameStart;
+
+    for (int phase = 0; phase < NUM_FRAME_PHASES && running_; ++phase) {
+      switch (phase) {
+      case FRAME_INPUT:
+        glutMainLoopEvent();
+        if (!glutGetWindow())
+          running_ = false;     // the window was closed
+        break;
+
+      case FRAME_PRESENT:
+        glutSwapBuffers();
+        break;
+
+      case FRAME_WAIT:
+        if (pacing_ == PACING_FIXED_RATE) {
+          // a frame running late starts the schedule over rather than rushing to catch up
+          deadline += period_;
+          const Clock::time_point now = Clock::now();
+          if (deadline < now)
+            deadline = now;
+          else
+            this_thread::sleep_until(deadline);
+        }
+        break;
+
+      default:
+        if (*callbacks[phase])
+          (*callbacks[phase])();
+        break;
+      }
+
+      const Clock::time_point end = Clock::now();
+      phaseMs_[slot][phase] = chrono::duration<double, milli>(end - start).count();
+      start = end;
+    }
+
+    frameMs_[slot] = chrono::duration<double, milli>(start - frameStart).count();
+    ++numFrames_;
+  }
+}
+
+double FrameLoop::meanMs(FramePhase phase) const {
+  const int n = static_cast<int>(min<long long>(numFrames_, STATS_FRAMES));
+  double sum = 0;
+  for (int i = 0; i < n; ++i)
+    sum += phaseMs_[i][phase];
+  return n ? sum / n : 0;
+}
+
+double FrameLoop::meanFrameMs() const {
+  const int n = static_cast<int>(min<long long>(numFrames_, STATS_FRAMES));
+  double sum = 0;
+  for (int i = 0; i < n; ++i)
+    sum += frameMs_[i];
+  return n ? sum / n : 0;
+}
+
+double FrameLoop::lastMs(FramePhase phase) const {
+  return numFrames_ ? phaseMs_[(numFrames_ - 1) % STATS_FRAMES][phase] : 0;
+}
+
+double FrameLoop::lastFrameMs() const {
+  return numFrames_ ? frameMs_[(numFrames_ - 1) % STATS_FRAMES] : 0;
+}
+
+void FrameLoop::printStats(ostream& os) const {
+  const double frameMs = meanFrameMs();
+  os << "Frame: " << frameMs << " ms (" << (frameMs > 0 ? 1000 / frameMs : 0) << " fps) over the last "
+     << min<long long>(numFrames_, STATS_FRAMES) << " frames";
+  for (int phase = 0; phase < NUM_FRAME_PHASES; ++phase)
+    os << ", " << phaseName(static_cast<FramePhase>(phase)) << " " << meanMs(static_cast<FramePhase>(phase));
+  os << endl;
+}
+
+FramePacing FrameLoop::parsePacing(const char* s, double& rateHz) {
+  if (strcmp(s, "vsync") == 0)
+    return PACING_VSYNC;
+  if (strcmp(s, "benchmark") == 0)
+    return PACING_BENCHMARK;
+  char* end;
+  rateHz = strtod(s, &end);
+  if (end == s || *end != '\0' || rateHz < 1)
+    throw runtime_error(string("Unknown frame pacing ") + s + ", expected vsync, benchmark or a rate in Hz");
+  return PACING_FIXED_RATE;
+}
+
+const char* FrameLoop::phaseName(FramePhase phase) {
+  static const char* const names[NUM_FRAME_PHASES] = { "input", "update", "cull", "render", "present", "wait" };
+  return names[phase];
+}
@@ -0,0 +1,90 @@
+#ifndef FRAMELOOP_H
+#define FRAMELOOP_H
+
+#include <chrono>
+#include <functional>
+#include <iosfwd>
+
+//--------------------------------------------------------------------------------
+// An explicit frame loop over freeglut, timing every phase of a frame
+//--------------------------------------------------------------------------------
+
+
+// The phases of a frame, in the order they run
+enum FramePhase {
+  FRAME_INPUT,      // window events dispatched to the GLUT callbacks, which only record them
+  FRAME_UPDATE,
+  FRAME_CULL,
+  FRAME_RENDER,
+  FRAME_PRESENT,    // the buffer swap, with vsync including the wait for the display
+  FRAME_WAIT,       // sleeping to the fixed rate
+  NUM_FRAME_PHASES
+};
+
+enum FramePacing {
+  PACING_VSYNC,       // one frame per display refresh
+  PACING_BENCHMARK,   // as many frames as possible: no vsync, no sleeping
+  PACING_FIXED_RATE   // no vsync, sleeps between frames to hold a rate, to save power
+};
+
+// What the application runs in each phase; any may be empty
+struct FramePhases {
+  std::function<void()> update, cull, render;
+};
+
+// Replaces glutMainLoop. Every frame dispatches the pending window events with
+// glutMainLoopEvent, runs the phases of the application, swaps and paces. The
+// GLUT display callback must still be registered but is never relied on.
+class FrameLoop {
+public:
+  static const int STATS_FRAMES = 128;   // frames the statistics are taken over
+
+  FrameLoop();
+
+  // Selects the pacing; rateHz is for PACING_FIXED_RATE. Sets the swap
+  // interval, so needs a current GL context with its extensions loaded.
+  void setPacing(FramePacing pacing, double rateHz = 30);
+
+  FramePacing pacing() const {
+    return pacing_;
+  }
+
+  // Runs frames until stop is called or the window is closed
+  void run(const FramePhases& phases);
+
+  void stop() {
+    running_ = false;
+  }
+
+  long long numFrames() const {
+    return numFrames_;
+  }
+
+  // Mean milliseconds of a phase, and of whole frames, over the last
+  // STATS_FRAMES frames
+  double meanMs(FramePhase phase) const;
+  double meanFrameMs() const;
+
+  // Milliseconds of a phase, and of the whole frame, in the last frame run
+  double lastMs(FramePhase phase) const;
+  double lastFrameMs() const;
+
+  void printStats(std::ostream& os) const;
+
+  // "vsync", "benchmark", or a fixed rate in Hz. Throws runtime_error.
+  static FramePacing parsePacing(const char* s, double& rateHz);
+
+  static const char* phaseName(FramePhase phase);
+
+private:
+  typedef std::chrono::steady_clock Clock;
+
+  FramePacing pacing_;
+  Clock::duration period_;    // of PACING_FIXED_RATE
+  bool running_;
+  long long numFrames_;
+  double phaseMs_[STATS_FRAMES][NUM_FRAME_PHASES];
+  double frameMs_[STATS_FRAMES];
+};
+
+#endif
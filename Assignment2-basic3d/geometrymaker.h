@@ -1,7 +1,11 @@
 #ifndef GEOMETRYMAKER_H
 #define GEOMETRYMAKER_H
 
+#include <algorithm>
 #include <cmath>
+#include <functional>
+#include <thread>
+#include <vector>
 
 #include "cvec.h"
 
@@ -176,4 +180,134 @@ void makeSphere(float radius, int slices, int stacks, VtxOutIter vtxIter, IdxOut
 }
 
 
+// Destination of generated vertex attributes, as float pointers advancing by
+// stride floats per vertex. Pointing them into one struct array gives AoS
+// output (e.g., VertexPNT, or a mapped GL buffer of them), pointing them at
+// separate arrays with their own component count as stride gives SoA. NULL
+// attributes are not written.
+struct VertexSpan {
+  float* pos;
+  float* normal;
+  float* tex;
+  float* tangent;
+  float* binormal;
+  int posStride, normalStride, texStride, tangentStride, binormalStride;
+
+  VertexSpan()
+    : pos(NULL), normal(NULL), tex(NULL), tangent(NULL), binormal(NULL),
+      posStride(3), normalStride(3), texStride(2), tangentStride(3), binormalStride(3) {}
+};
+
+// Writes the vertices and indices of slices [sliceBegin, sliceEnd) of the
+// sphere made by makeSphere, in the same layout: vertex (i, j) of slice i and
+// stack j is at (stacks + 1) * i + j and slice i has its 6 * stacks indices
+// at 6 * stacks * i. Disjoint slice ranges write disjoint memory, so they can
+// be generated by different threads. latSin/latCos are the stacks + 1 values
+// of the latitude table.
+template<typename Idx>
+void makeSphereSlices(float radius, int slices, int stacks, int sliceBegin, int sliceEnd,
+                      const float* latSin, const float* latCos, const VertexSpan& out, Idx* idx) {
+  const double radPerSlice = 2 * CS175_PI / slices;
+
+  for (int i = sliceBegin; i < sliceEnd; ++i) {
+    const float ls = static_cast<float>(std::sin(radPerSlice * i));
+    const float lc = static_cast<float>(std::cos(radPerSlice * i));
+    const float u = 1.0f / slices * i;
+    const size_t first = static_cast<size_t>(stacks + 1) * i;
+
+    // the stack loop only streams through the latitude tables
+    if (out.pos) {
+      float* p = out.pos + first * out.posStride;
+      for (int j = 0; j <= stacks; ++j, p += out.posStride) {
+        p[0] = lc * latSin[j] * radius;
+        p[1] = ls * latSin[j] * radius;
+        p[2] = latCos[j] * radius;
+      }
+    }
+    if (out.normal) {
+      float* n = out.normal + first * out.normalStride;
+      for (int j = 0; j <= stacks; ++j, n += out.normalStride) {
+        n[0] = lc * latSin[j];
+        n[1] = ls * latSin[j];
+        n[2] = latCos[j];
+      }
+    }
+    if (out.tex) {
+      float* t = out.tex + first * out.texStride;
+      for (int j = 0; j <= stacks; ++j, t += out.texStride) {
+        t[0] = u;
+        t[1] = 1.0f / stacks * j;
+      }
+    }
+    if (out.tangent) {
+      float* t = out.tangent + first * out.tangentStride;
+      for (int j = 0; j <= stacks; ++j, t += out.tangentStride) {
+        t[0] = -ls;
+        t[1] = lc;
+        t[2] = 0;
+      }
+    }
+    if (out.binormal) {
+      // cross(n, t) with n = (lc * s, ls * s, c) and t = (-ls, lc, 0)
+      float* b = out.binormal + first * out.binormalStride;
+      for (int j = 0; j <= stacks; ++j, b += out.binormalStride) {
+        b[0] = -latCos[j] * lc;
+        b[1] = -latCos[j] * ls;
+        b[2] = latSin[j];
+      }
+    }
+
+    if (idx && i < slices) {
+      Idx* o = idx + static_cast<size_t>(6) * stacks * i;
+      for (int j = 0; j < stacks; ++j) {
+        const Idx a = static_cast<Idx>(first + j), b = static_cast<Idx>(first + stacks + 1 + j);
+        o[0] = a;
+        o[1] = a + 1;
+        o[2] = b + 1;
+        o[3] = a;
+        o[4] = b + 1;
+        o[5] = b;
+        o += 6;
+      }
+    }
+  }
+}
+
+// makeSphere writing straight into preallocated storage of the sizes given by
+// getSphereVbIbLen, e.g., a mapped GL buffer. Large spheres are split by
+// slices over up to maxThreads threads (0 for the hardware concurrency).
+template<typename Idx>
+void makeSphere(float radius, int slices, int stacks, const VertexSpan& out, Idx* idx, int maxThreads = 0) {
+  assert(slices > 1);
+  assert(stacks >= 2);
+
+  const double radPerStack = CS175_PI / stacks;
+  std::vector<float> latSin(stacks + 1), latCos(stacks + 1);
+  for (int j = 0; j <= stacks; ++j) {
+    latSin[j] = static_cast<float>(std::sin(radPerStack * j));
+    latCos[j] = static_cast<float>(std::cos(radPerStack * j));
+  }
+
+  // the last slice only has vertices, closing the seam
+  const int numSlices = slices + 1;
+  static const int MIN_VERTICES_PER_THREAD = 16384;
+  int numThreads = maxThreads > 0 ? maxThreads : static_cast<int>(std::thread::hardware_concurrency());
+  numThreads = std::max(1, std::min(numThreads, numSlices * (stacks + 1) / MIN_VERTICES_PER_THREAD));
+
+  if (numThreads == 1) {
+    makeSphereSlices(radius, slices, stacks, 0, numSlices, &latSin[0], &latCos[0], out, idx);
+    return;
+  }
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < numThreads; ++t) {
+    const int begin = numSlices * t / numThreads, end = numSlices * (t + 1) / numThreads;
+    threads.push_back(std::thread(makeSphereSlices<Idx>, radius, slices, stacks, begin, end,
+                                  &latSin[0], &latCos[0], std::cref(out), idx));
+  }
+  for (size_t t = 0; t < threads.size(); ++t)
+    threads[t].join();
+}
+
+
 #endif
@@ -5,6 +5,7 @@
 #include <stdexcept>
 
 #include "glsupport2.h"
+#include "profiler.h"
 
 using namespace std;
 
@@ -62,6 +63,131 @@ void checkGlErrors() {
     }
 }
 
+GlNamePool::~GlNamePool() {
+  if (all_.empty())
+    return;
+  const GLsizei n = static_cast<GLsizei>(all_.size());
+  switch (kind_) {
+  case GL_NAME_BUFFER:
+    glDeleteBuffers(n, &all_[0]);
+    break;
+  case GL_NAME_TEXTURE:
+    glDeleteTextures(n, &all_[0]);
+    break;
+  case GL_NAME_VERTEX_ARRAY:
+    glDeleteVertexArrays(n, &all_[0]);
+    break;
+  }
+}
+
+GLuint GlNamePool::acquire() {
+  if (free_.empty()) {
+    // Generate a whole batch with one driver call
+    free_.resize(batchSize_);
+    switch (kind_) {
+    case GL_NAME_BUFFER:
+      glGenBuffers(batchSize_, &free_[0]);
+      break;
+    case GL_NAME_TEXTURE:
+      glGenTextures(batchSize_, &free_[0]);
+      break;
+    case GL_NAME_VERTEX_ARRAY:
+      glGenVertexArrays(batchSize_, &free_[0]);
+      break;
+    }
+    checkGlErrors();
+    all_.insert(all_.end(), free_.begin(), free_.end());
+  }
+  const GLuint name = free_.back();
+  free_.pop_back();
+  return name;
+}
+
+void GlNamePool::release(GLuint name) {
+  free_.push_back(name);
+}
+
+StreamBuffer::StreamBuffer(GLenum target, GLsizeiptr segmentSize, int numSegments)
+  : target_(target), segmentSize_(segmentSize), numSegments_(numSegments),
+    segment_(0), head_(0), flushed_(0), mapped_(NULL), fences_(numSegments, (GLsync)0),
+    bytesUploaded_(0) {
+  glBindBuffer(target_, buffer_);
+  if (GLEW_ARB_buffer_storage) {
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(target_, segmentSize_ * numSegments_, NULL, flags);
+    mapped_ = static_cast<char*>(glMapBufferRange(target_, 0, segmentSize_ * numSegments_, flags));
+  }
+  if (mapped_ == NULL) {
+    // Fallback: one segment, orphaned every frame
+    glBufferData(target_, segmentSize_, NULL, GL_STREAM_DRAW);
+    staging_.resize(segmentSize_);
+  }
+  checkGlErrors();
+}
+
+StreamBuffer::~StreamBuffer() {
+  for (size_t i = 0; i < fences_.size(); ++i) {
+    if (fences_[i])
+      glDeleteSync(fences_[i]);
+  }
+  if (mapped_) {
+    glBindBuffer(target_, buffer_);
+    glUnmapBuffer(target_);
+  }
+}
+
+void StreamBuffer::beginFrame() {
+  head_ = flushed_ = 0;
+  if (mapped_ == NULL) {
+    // Orphan the old storage so the driver does not wait for the GPU to finish with it
+    glBindBuffer(target_, buffer_);
+    glBufferData(target_, segmentSize_, NULL, GL_STREAM_DRAW);
+    return;
+  }
+
+  segment_ = (segment_ + 1) % numSegments_;
+  GLsync& fence = fences_[segment_];
+  if (fence) {
+    GLenum r = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000); // 1 ms
+    while (r == GL_TIMEOUT_EXPIRED)
+      r = glClientWaitSync(fence, 0, 1000000);
+    if (r == GL_WAIT_FAILED)
+      throw std::runtime_error("glClientWaitSync fails on stream buffer segment");
+    glDeleteSync(fence);
+    fence = 0;
+  }
+}
+
+void StreamBuffer::endFrame() {
+  flush();
+  if (mapped_)
+    fences_[segment_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void* StreamBuffer::allocate(GLsizeiptr size, GLsizeiptr alignment, GLintptr& offset) {
+  const GLsizeiptr start = (head_ + alignment - 1) / alignment * alignment;
+  if (start + size > segmentSize_)
+    throw std::runtime_error("StreamBuffer segment is full");
+
+  head_ = start + size;
+  if (mapped_) {
+    offset = segment_ * segmentSize_ + start;
+    bytesUploaded_ += size;
+    return mapped_ + offset;
+  }
+  offset = start;
+  return &staging_[start];
+}
+
+void StreamBuffer::flush() {
+  if (mapped_ || head_ == flushed_)
+    return;
+  glBindBuffer(target_, buffer_);
+  glBufferSubData(target_, flushed_, head_ - flushed_, &staging_[flushed_]);
+  bytesUploaded_ += head_ - flushed_;
+  flushed_ = head_;
+}
+
 //void checkGlErrors() {
 //  const GLenum errCode = glGetError();
 //
@@ -141,6 +267,7 @@ void linkShader(GLuint programHandle, GLuint vs, GLuint fs) {
 
 
 void readAndCompileShader(GLuint programHandle, const char * vertexShaderFileName, const char * fragmentShaderFileName) {
+  PROFILE_SCOPE("readAndCompileShader");
   GlShader vs(GL_VERTEX_SHADER);
   GlShader fs(GL_FRAGMENT_SHADER);
 
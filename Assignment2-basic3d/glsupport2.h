@@ -1,8 +1,11 @@
 #ifndef GLSUPPORT_H
 #define GLSUPPORT_H
 
+#include <cstring>
 #include <iostream>
 #include <stdexcept>
+#include <utility>
+#include <vector>
 
 #include <GL/glew.h>
 #ifdef __MAC__
@@ -47,8 +50,42 @@ private:
   const Noncopyable& operator= (const Noncopyable&);
 };
 
+// Kinds of GL object names that can be handed out by a GlNamePool
+enum GlNameKind {
+  GL_NAME_BUFFER,
+  GL_NAME_TEXTURE,
+  GL_NAME_VERTEX_ARRAY
+};
+
+// Hands out GL object names generated in batches by a single glGen* call, and
+// recycles names given back instead of deleting them. A recycled name keeps
+// whatever storage it had, so the caller must respecify its contents (e.g.,
+// glBufferData, glTexImage2D). Names are only generated on first use, so a
+// pool can be a global constructed before the GL context exists. The pool must
+// outlive every wrapper that took a name from it.
+class GlNamePool : Noncopyable {
+  GlNameKind kind_;
+  GLsizei batchSize_;
+  std::vector<GLuint> free_;  // names ready to be handed out
+  std::vector<GLuint> all_;   // every name generated, deleted with the pool
+
+public:
+  explicit GlNamePool(GlNameKind kind, GLsizei batchSize = 64)
+    : kind_(kind), batchSize_(batchSize) {}
+
+  ~GlNamePool();
+
+  GLuint acquire();
+  void release(GLuint name);
+
+  // Number of names generated so far, and how many of them are unused
+  size_t numGenerated() const { return all_.size(); }
+  size_t numFree() const { return free_.size(); }
+};
+
 // Light wrapper around a GL shader (can be geometry/vertex/fragment shader)
 // handle. Automatically allocates and deallocates. Can be casted to GLuint.
+// Movable, so it can be stored by value in containers.
 class GlShader : Noncopyable {
 protected:
   GLuint handle_;
@@ -61,8 +98,17 @@ public:
     checkGlErrors();
   }
 
+  GlShader(GlShader&& other) noexcept : handle_(other.handle_) {
+    other.handle_ = 0;
+  }
+
+  GlShader& operator= (GlShader&& other) noexcept {
+    std::swap(handle_, other.handle_);
+    return *this;
+  }
+
   ~GlShader() {
-    glDeleteShader(handle_);
+    glDeleteShader(handle_); // deleting 0 (moved-from) is silently ignored
   }
 
   // Casts to GLuint so can be used directly by glCompile etc
@@ -72,7 +118,7 @@ public:
 };
 
 // Light wrapper around GLSL program handle that automatically allocates
-// and deallocates. Can be casted to a GLuint.
+// and deallocates. Can be casted to a GLuint. Movable.
 class GlProgram : Noncopyable {
 protected:
   GLuint handle_;
@@ -85,6 +131,15 @@ public:
     checkGlErrors();
   }
 
+  GlProgram(GlProgram&& other) noexcept : handle_(other.handle_) {
+    other.handle_ = 0;
+  }
+
+  GlProgram& operator= (GlProgram&& other) noexcept {
+    std::swap(handle_, other.handle_);
+    return *this;
+  }
+
   ~GlProgram() {
     glDeleteProgram(handle_);
   }
@@ -95,69 +150,230 @@ public:
   }
 };
 
-// Light wrapper around a GL texture object handle that automatically allocates
-// and deallocates. Can be casted to a GLuint.
-class GlTexture : Noncopyable {
+// Base of the wrappers below whose names come from glGen*. The name is either
+// generated on its own or taken from a GlNamePool, in which case it goes back
+// to the pool instead of being deleted. Movable.
+template <GlNameKind kind>
+class GlGenObject : Noncopyable {
 protected:
   GLuint handle_;
+  GlNamePool* pool_;
 
-public:
-  GlTexture() {
-    glGenTextures(1, &handle_);
-    checkGlErrors();
+  GlGenObject() : pool_(NULL) {}
+
+  explicit GlGenObject(GlNamePool& pool) : pool_(&pool) {
+    handle_ = pool.acquire();
+  }
+
+  GlGenObject(GlGenObject&& other) noexcept : handle_(other.handle_), pool_(other.pool_) {
+    other.handle_ = 0;
+    other.pool_ = NULL;
   }
 
-  ~GlTexture() {
-    glDeleteTextures(1, &handle_);
+  GlGenObject& operator= (GlGenObject&& other) noexcept {
+    std::swap(handle_, other.handle_);
+    std::swap(pool_, other.pool_);
+    return *this;
   }
 
-  // Casts to GLuint so can be used directly by glBindTexture and so on
-  operator GLuint () const {
+  ~GlGenObject() {
+    if (handle_ == 0)
+      return;
+    if (pool_)
+      pool_->release(handle_);
+    else if (kind == GL_NAME_BUFFER)
+      glDeleteBuffers(1, &handle_);
+    else if (kind == GL_NAME_TEXTURE)
+      glDeleteTextures(1, &handle_);
+    else
+      glDeleteVertexArrays(1, &handle_);
+  }
+
+public:
+  // Casts to GLuint so can be used directly by glBind* and so on
+  operator GLuint() const {
     return handle_;
   }
 };
 
-// Light wrapper around a GL Vertex Array object handle that automatically allocates
+// Light wrapper around a GL texture object handle that automatically allocates
 // and deallocates. Can be casted to a GLuint.
-class GlVertexArrayObject : Noncopyable {
-protected:
-    GLuint handle_;
+class GlTexture : public GlGenObject<GL_NAME_TEXTURE> {
+public:
+  GlTexture() {
+    glGenTextures(1, &handle_);
+    checkGlErrors();
+  }
 
+  explicit GlTexture(GlNamePool& pool) : GlGenObject<GL_NAME_TEXTURE>(pool) {}
+};
+
+// Light wrapper around a GL Vertex Array object handle that automatically allocates
+// and deallocates. Can be casted to a GLuint.
+class GlVertexArrayObject : public GlGenObject<GL_NAME_VERTEX_ARRAY> {
 public:
     GlVertexArrayObject() {
         GLCall(glGenVertexArrays(1, &handle_));
         checkGlErrors();
     }
 
-    ~GlVertexArrayObject() {
-        glDeleteVertexArrays(1, &handle_);
-    }
-
-    // Casts to GLuint so can be used directly glBindBuffer and so on
-    operator GLuint() const {
-        return handle_;
-    }
+    explicit GlVertexArrayObject(GlNamePool& pool) : GlGenObject<GL_NAME_VERTEX_ARRAY>(pool) {}
 };
 
 // Light wrapper around a GL buffer object handle that automatically allocates
 // and deallocates. Can be casted to a GLuint.
-class GlBufferObject : Noncopyable {
-protected:
-  GLuint handle_;
-
+class GlBufferObject : public GlGenObject<GL_NAME_BUFFER> {
 public:
   GlBufferObject() {
     glGenBuffers(1, &handle_);
     checkGlErrors();
   }
 
-  ~GlBufferObject() {
-    glDeleteBuffers(1, &handle_);
+  explicit GlBufferObject(GlNamePool& pool) : GlGenObject<GL_NAME_BUFFER>(pool) {}
+};
+
+// Marks a primitive restart in the 32 bit indices given to packIndices
+static const unsigned PRIMITIVE_RESTART = 0xffffffffu;
+
+// Returns the narrowest of GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT and
+// GL_UNSIGNED_INT that can index numVertices vertices. The largest value of
+// the type is kept free as its primitive restart index.
+inline GLenum indexTypeFor(size_t numVertices) {
+  if (numVertices <= 0xff)
+    return GL_UNSIGNED_BYTE;
+  if (numVertices <= 0xffff)
+    return GL_UNSIGNED_SHORT;
+  return GL_UNSIGNED_INT;
+}
+
+inline int indexSize(GLenum type) {
+  return type == GL_UNSIGNED_BYTE ? 1 : (type == GL_UNSIGNED_SHORT ? 2 : 4);
+}
+
+inline GLuint restartIndexFor(GLenum type) {
+  return type == GL_UNSIGNED_BYTE ? 0xff : (type == GL_UNSIGNED_SHORT ? 0xffff : 0xffffffffu);
+}
+
+// Narrows 32 bit indices to type, PRIMITIVE_RESTART becoming the restart
+// index of the type, and returns them as raw bytes ready for glBufferData
+inline std::vector<unsigned char> packIndices(const unsigned* idx, size_t n, GLenum type) {
+  const int size = indexSize(type);
+  const GLuint restart = restartIndexFor(type);
+  std::vector<unsigned char> out(n * size);
+  for (size_t i = 0; i < n; ++i) {
+    const GLuint v = idx[i] == PRIMITIVE_RESTART ? restart : idx[i];
+    if (size == 1) {
+      out[i] = static_cast<unsigned char>(v);
+    }
+    else if (size == 2) {
+      const GLushort s = static_cast<GLushort>(v);
+      memcpy(&out[i * 2], &s, 2);
+    }
+    else {
+      memcpy(&out[i * 4], &v, 4);
+    }
+  }
+  return out;
+}
+
+// A ring of per-frame segments inside one GL buffer, for data rewritten every
+// frame (debug lines, dynamic geometry, per-object uniforms). Producers
+// allocate from the current segment, write through the returned pointer and
+// source the data from the returned offset.
+//
+// With ARB_buffer_storage the whole ring is mapped once (persistent, coherent)
+// and every segment is fenced after the frame that used it, so the CPU never
+// overwrites data the GPU is still reading. Otherwise writes go to a client
+// side copy that flush() uploads with glBufferSubData, into a single segment
+// that is orphaned at the start of every frame.
+class StreamBuffer : Noncopyable {
+  GLenum target_;
+  GlBufferObject buffer_;
+  GLsizeiptr segmentSize_;
+  int numSegments_;
+  int segment_;             // segment used by the current frame
+  GLsizeiptr head_;         // bytes allocated in the current segment
+  GLsizeiptr flushed_;      // bytes of the current segment already visible to GL
+  char* mapped_;            // start of the persistent mapping, NULL on the fallback path
+  std::vector<GLsync> fences_;
+  std::vector<char> staging_;
+  size_t bytesUploaded_;    // running total, for statistics
+
+public:
+  StreamBuffer(GLenum target, GLsizeiptr segmentSize, int numSegments = 3);
+  ~StreamBuffer();
+
+  // Moves on to the next segment, waiting for the GPU to release it first
+  void beginFrame();
+
+  // Fences the current segment. Call once all draws using this frame's data
+  // have been issued.
+  void endFrame();
+
+  // Reserves size bytes aligned to alignment in the current segment. Returns
+  // where to write them, and in offset where they live in the GL buffer.
+  // Throws runtime_error when the segment is full.
+  void* allocate(GLsizeiptr size, GLsizeiptr alignment, GLintptr& offset);
+
+  // Makes all data allocated since the last flush visible to GL. Must be
+  // called before drawing from it. Does nothing on the persistent path.
+  void flush();
+
+  bool isPersistent() const {
+    return mapped_ != NULL;
+  }
+
+  size_t bytesUploaded() const {
+    return bytesUploaded_;
   }
 
-  // Casts to GLuint so can be used directly glBindBuffer and so on
+  // Casts to GLuint so can be used directly by glBindBuffer and so on
   operator GLuint() const {
-    return handle_;
+    return buffer_;
+  }
+};
+
+
+// Remembers the bound program and vertex array, and skips binding either
+// again, counting the binds skipped. Forgets both in beginFrame, so only the
+// binds made during a frame must go through it; a name deleted and generated
+// again mid-frame would be taken for the old one.
+class GlStateCache : Noncopyable {
+  GLuint program_, vertexArray_;
+  bool programKnown_, vertexArrayKnown_;
+  int skipped_;
+
+public:
+  GlStateCache() : program_(0), vertexArray_(0), programKnown_(false), vertexArrayKnown_(false), skipped_(0) {}
+
+  void beginFrame() {
+    programKnown_ = vertexArrayKnown_ = false;
+    skipped_ = 0;
+  }
+
+  void useProgram(GLuint program) {
+    if (programKnown_ && program == program_) {
+      ++skipped_;
+      return;
+    }
+    glUseProgram(program);
+    program_ = program;
+    programKnown_ = true;
+  }
+
+  void bindVertexArray(GLuint vertexArray) {
+    if (vertexArrayKnown_ && vertexArray == vertexArray_) {
+      ++skipped_;
+      return;
+    }
+    glBindVertexArray(vertexArray);
+    vertexArray_ = vertexArray;
+    vertexArrayKnown_ = true;
+  }
+
+  // Binds skipped since beginFrame
+  int skipped() const {
+    return skipped_;
   }
 };
 
@@ -0,0 +1,146 @@
+#include <algorithm>
+#include <ostream>
+
+#include "gpuprofiler.h"
+
+using namespace std;
+
+static const int QUERIES_PER_FRAME = 2 * (GpuProfiler::MAX_PASSES + 1);   // the passes and the frame
+
+GpuProfiler::GpuProfiler() : current_(0), numFrames_(0) {
+  supported_ = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+  for (int i = 0; i < FRAMES; ++i) {
+    frames_[i].numQueries = 0;
+    frames_[i].pending = false;
+  }
+  if (supported_) {
+    queries_.resize(FRAMES * QUERIES_PER_FRAME);
+    glGenQueries(static_cast<GLsizei>(queries_.size()), &queries_[0]);
+  }
+#ifdef ENABLE_PROFILER
+  track_ = profileRegisterTrack("GPU");
+#endif
+}
+
+GpuProfiler::~GpuProfiler() {
+  if (!queries_.empty())
+    glDeleteQueries(static_cast<GLsizei>(queries_.size()), &queries_[0]);
+}
+
+void GpuProfiler::beginFrame() {
+  if (!supported_)
+    return;
+  current_ = static_cast<int>(numFrames_ % FRAMES);
+  Frame& frame = frames_[current_];
+  const GLuint* block = &queries_[current_ * QUERIES_PER_FRAME];
+
+  // the queries complete in order, so the last one tells for the whole frame
+  if (frame.pending && frame.numQueries > 0) {
+    GLint available = 0;
+    glGetQueryObjectiv(block[frame.numQueries - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (available)
+      resolve(frame, block);
+  }
+
+  frame.passes.clear();
+  frame.numQueries = 0;
+  frame.pending = false;
+  open_.clear();
+#ifdef ENABLE_PROFILER
+  glGetInteger64v(GL_TIMESTAMP, &frame.syncGpuNs);
+  frame.syncTicks = profileTicks();
+#endif
+  beginPass("frame");
+}
+
+void GpuProfiler::endFrame() {
+  if (!supported_)
+    return;
+  while (!open_.empty())
+    endPass();
+  frames_[current_].pending = true;
+  ++numFrames_;
+}
+
+int GpuProfiler::query() {
+  Frame& frame = frames_[current_];
+  const int i = frame.numQueries++;
+  glQueryCounter(queries_[current_ * QUERIES_PER_FRAME + i], GL_TIMESTAMP);
+  return i;
+}
+
+void GpuProfiler::beginPass(const char* name) {
+  if (!supported_)
+    return;
+  Frame& frame = frames_[current_];
+  if (frame.passes.size() > static_cast<size_t>(MAX_PASSES)) {
+    open_.push_back(-1);
+    return;
+  }
+  Pass pass = { name, query(), -1 };
+  open_.push_back(static_cast<int>(frame.passes.size()));
+  frame.passes.push_back(pass);
+}
+
+void GpuProfiler::endPass() {
+  if (!supported_ || open_.empty())
+    return;
+  const int i = open_.back();
+  open_.pop_back();
+  if (i >= 0)
+    frames_[current_].passes[i].end = query();
+}
+
+void GpuProfiler::resolve(Frame& frame, const GLuint* queries) {
+#ifdef ENABLE_PROFILER
+  const double ticksPerNs = profileTicksPerSecond() * 1e-9;
+#endif
+  for (size_t i = 0; i < frame.passes.size(); ++i) {
+    const Pass& pass = frame.passes[i];
+    if (pass.end < 0)
+      continue;
+    GLuint64 begin, end;
+    glGetQueryObjectui64v(queries[pass.begin], GL_QUERY_RESULT, &begin);
+    glGetQueryObjectui64v(queries[pass.end], GL_QUERY_RESULT, &end);
+
+    History& h = history_[pass.name];   // value initialized, so zeroed when new
+    h.ms[h.count++ % STATS_FRAMES] = (end - begin) * 1e-6;
+
+#ifdef ENABLE_PROFILER
+    const double offset = static_cast<double>(static_cast<GLint64>(begin) - frame.syncGpuNs) * ticksPerNs;
+    const unsigned long long start = frame.syncTicks + static_cast<long long>(offset);
+    profileRecordTo(track_, pass.name, start, start + static_cast<unsigned long long>((end - begin) * ticksPerNs));
+#endif
+  }
+}
+
+double GpuProfiler::meanMs(const string& pass) const {
+  const map<string, History>::const_iterator i = history_.find(pass);
+  if (i == history_.end())
+    return 0;
+  const int n = static_cast<int>(min<long long>(i->second.count, STATS_FRAMES));
+  double sum = 0;
+  for (int k = 0; k < n; ++k)
+    sum += i->second.ms[k];
+  return n ? sum / n : 0;
+}
+
+double GpuProfiler::lastMs(const string& pass) const {
+  const map<string, History>::const_iterator i = history_.find(pass);
+  if (i == history_.end() || i->second.count == 0)
+    return 0;
+  return i->second.ms[(i->second.count - 1) % STATS_FRAMES];
+}
+
+void GpuProfiler::printStats(ostream& os) const {
+  if (!supported_) {
+    os << "GPU: timer queries are unsupported" << endl;
+    return;
+  }
+  os << "GPU: frame " << meanMs("frame") << " ms";
+  for (map<string, History>::const_iterator i = history_.begin(); i != history_.end(); ++i) {
+    if (i->first != "frame")
+      os << ", " << i->first << " " << meanMs(i->first);
+  }
+  os << endl;
+}
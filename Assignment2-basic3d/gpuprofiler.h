@@ -0,0 +1,107 @@
+#ifndef GPUPROFILER_H
+#define GPUPROFILER_H
+
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "profiler.h"
+
+//--------------------------------------------------------------------------------
+// GPU timing of named render passes with timestamp queries
+//--------------------------------------------------------------------------------
+
+
+// Brackets every pass of a frame with a pair of GL_TIMESTAMP queries. The
+// queries of a frame are only read FRAMES frames later, by when the GPU has
+// long finished them, so reading never stalls; a frame whose results are
+// still not in is skipped. Passes may nest. Keeps the mean milliseconds of
+// every pass, and of the whole frame as "frame", over the last STATS_FRAMES
+// frames. Built with ENABLE_PROFILER, the passes also go into the profiler
+// as a "GPU" track, placed on the CPU timeline by reading the GPU clock with
+// the CPU clock at the start of every frame.
+//
+// Needs a GL context; does nothing without ARB_timer_query (GL 3.3).
+class GpuProfiler {
+public:
+  static const int FRAMES = 4;
+  static const int MAX_PASSES = 32;     // per frame, further passes are not timed
+  static const int STATS_FRAMES = 128;
+
+  GpuProfiler();
+  ~GpuProfiler();
+
+  bool supported() const {
+    return supported_;
+  }
+
+  // Reads the results of the frame FRAMES frames ago and starts a new one
+  void beginFrame();
+  void endFrame();
+
+  // name must outlive the profiler, e.g., a string literal
+  void beginPass(const char* name);
+  void endPass();
+
+  // Mean milliseconds of a pass, 0 if it never ran
+  double meanMs(const std::string& pass) const;
+
+  // Milliseconds of a pass in the latest frame read back, 0 if it never ran
+  double lastMs(const std::string& pass) const;
+
+  void printStats(std::ostream& os) const;
+
+private:
+  struct Pass {
+    const char* name;
+    int begin, end;                     // query indices into the frame's block
+  };
+
+  struct Frame {
+    std::vector<Pass> passes;
+    int numQueries;
+    bool pending;                       // issued and not read yet
+#ifdef ENABLE_PROFILER
+    GLint64 syncGpuNs;                  // GPU clock read together with
+    unsigned long long syncTicks;       // the CPU ticks
+#endif
+  };
+
+  struct History {
+    double ms[STATS_FRAMES];
+    long long count;
+  };
+
+  int query();
+  void resolve(Frame& frame, const GLuint* queries);
+
+  bool supported_;
+  std::vector<GLuint> queries_;         // FRAMES blocks of 2 * (MAX_PASSES + 1)
+  Frame frames_[FRAMES];
+  int current_;                         // frame being recorded
+  long long numFrames_;
+  std::vector<int> open_;               // passes begun and not ended
+  std::map<std::string, History> history_;
+#ifdef ENABLE_PROFILER
+  ProfileRing* track_;
+#endif
+};
+
+// Times a pass for as long as it is in scope
+class GpuPass {
+  GpuProfiler& profiler_;
+
+public:
+  GpuPass(GpuProfiler& profiler, const char* name) : profiler_(profiler) {
+    profiler_.beginPass(name);
+  }
+
+  ~GpuPass() {
+    profiler_.endPass();
+  }
+};
+
+#endif
@@ -0,0 +1,237 @@
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <cstring>
+
+#include "hud.h"
+
+using namespace std;
+
+// Rows of the characters ' ' to '_', top first, the leftmost pixel in bit 4
+static const int FONT_FIRST = 32, FONT_COUNT = 64, FONT_ROWS = 7;
+static const unsigned char g_font5x7[FONT_COUNT * FONT_ROWS] = {
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,   // space
+  0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04,   // !
+  0x0a, 0x0a, 0x0a, 0x00, 0x00, 0x00, 0x00,   // "
+  0x0a, 0x0a, 0x1f, 0x0a, 0x1f, 0x0a, 0x0a,   // #
+  0x04, 0x0f, 0x14, 0x0e, 0x05, 0x1e, 0x04,   // $
+  0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03,   // %
+  0x0c, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0d,   // &
+  0x04, 0x04, 0x08, 0x00, 0x00, 0x00, 0x00,   // '
+  0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02,   // (
+  0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08,   // )
+  0x00, 0x04, 0x15, 0x0e, 0x15, 0x04, 0x00,   // *
+  0x00, 0x04, 0x04, 0x1f, 0x04, 0x04, 0x00,   // +
+  0x00, 0x00, 0x00, 0x00, 0x0c, 0x04, 0x08,   // ,
+  0x00, 0x00, 0x00, 0x1f, 0x00, 0x00, 0x00,   // -
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x0c, 0x0c,   // .
+  0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00,   // /
+  0x0e, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0e,   // 0
+  0x04, 0x0c, 0x04, 0x04, 0x04, 0x04, 0x0e,   // 1
+  0x0e, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1f,   // 2
+  0x1f, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0e,   // 3
+  0x02, 0x06, 0x0a, 0x12, 0x1f, 0x02, 0x02,   // 4
+  0x1f, 0x10, 0x1e, 0x01, 0x01, 0x11, 0x0e,   // 5
+  0x06, 0x08, 0x10, 0x1e, 0x11, 0x11, 0x0e,   // 6
+  0x1f, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08,   // 7
+  0x0e, 0x11, 0x11, 0x0e, 0x11, 0x11, 0x0e,   // 8
+  0x0e, 0x11, 0x11, 0x0f, 0x01, 0x02, 0x0c,   // 9
+  0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x0c, 0x00,   // :
+  0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x04, 0x08,   // ;
+  0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02,   // <
+  0x00, 0x00, 0x1f, 0x00, 0x1f, 0x00, 0x00,   // =
+  0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08,   // >
+  0x0e, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04,   // ?
+  0x0e, 0x11, 0x01, 0x0d, 0x15, 0x15, 0x0e,   // @
+  0x0e, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11,   // A
+  0x1e, 0x11, 0x11, 0x1e, 0x11, 0x11, 0x1e,   // B
+  0x0e, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0e,   // C
+  0x1c, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1c,   // D
+  0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x1f,   // E
+  0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x10,   // F
+  0x0e, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0f,   // G
+  0x11, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11,   // H
+  0x0e, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0e,   // I
+  0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0c,   // J
+  0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11,   // K
+  0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1f,   // L
+  0x11, 0x1b, 0x15, 0x15, 0x11, 0x11, 0x11,   // M
+  0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11,   // N
+  0x0e, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e,   // O
+  0x1e, 0x11, 0x11, 0x1e, 0x10, 0x10, 0x10,   // P
+  0x0e, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0d,   // Q
+  0x1e, 0x11, 0x11, 0x1e, 0x14, 0x12, 0x11,   // R
+  0x0f, 0x10, 0x10, 0x0e, 0x01, 0x01, 0x1e,   // S
+  0x1f, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04,   // T
+  0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e,   // U
+  0x11, 0x11, 0x11, 0x11, 0x11, 0x0a, 0x04,   // V
+  0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0a,   // W
+  0x11, 0x11, 0x0a, 0x04, 0x0a, 0x11, 0x11,   // X
+  0x11, 0x11, 0x11, 0x0a, 0x04, 0x04, 0x04,   // Y
+  0x1f, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1f,   // Z
+  0x0e, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0e,   // [
+  0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00,   // backslash
+  0x0e, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0e,   // ]
+  0x04, 0x0a, 0x11, 0x00, 0x00, 0x00, 0x00,   // ^
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1f,   // _
+};
+
+// The atlas is a grid of character cells; the cell after the last character
+// is solid, for the rectangles
+static const int ATLAS_COLUMNS = 16;
+static const int ATLAS_WIDTH = ATLAS_COLUMNS * Hud::GLYPH_WIDTH;
+static const int ATLAS_HEIGHT = (FONT_COUNT / ATLAS_COLUMNS + 1) * Hud::GLYPH_HEIGHT;
+static const int SOLID_CELL = FONT_COUNT;
+
+Hud::Hud(const char* vsfn, const char* fsfn)
+  : vbo_(GL_ARRAY_BUFFER, sizeof(Vertex) * 4 * MAX_QUADS), windowWidth_(1), windowHeight_(1) {
+  readAndCompileShader(program_, vsfn, fsfn);
+  const GLuint h = program_;
+  h_uPixelScale_ = safe_glGetUniformLocation(h, "uPixelScale");
+  h_uFont_ = safe_glGetUniformLocation(h, "uFont");
+  h_aPosition_ = safe_glGetAttribLocation(h, "aPosition");
+  h_aTexCoord_ = safe_glGetAttribLocation(h, "aTexCoord");
+  h_aColor_ = safe_glGetAttribLocation(h, "aColor");
+  glBindFragDataLocation(h, 0, "fragColor");
+
+  // Bake the font into the atlas
+  vector<GLubyte> texels(ATLAS_WIDTH * ATLAS_HEIGHT, 0);
+  for (int c = 0; c <= SOLID_CELL; ++c) {
+    const int x0 = (c % ATLAS_COLUMNS) * GLYPH_WIDTH, y0 = (c / ATLAS_COLUMNS) * GLYPH_HEIGHT;
+    for (int y = 0; y < GLYPH_HEIGHT; ++y) {
+      for (int x = 0; x < GLYPH_WIDTH; ++x) {
+        const bool on = c == SOLID_CELL ||
+          (y < FONT_ROWS && x < 5 && (g_font5x7[c * FONT_ROWS + y] >> (4 - x) & 1));
+        texels[(y0 + y) * ATLAS_WIDTH + x0 + x] = on ? 255 : 0;
+      }
+    }
+  }
+  glBindTexture(GL_TEXTURE_2D, atlas_);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, ATLAS_WIDTH, ATLAS_HEIGHT, 0, GL_RED, GL_UNSIGNED_BYTE, &texels[0]);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+  // Two triangles per quad, the same for every frame
+  vector<GLushort> idx(6 * MAX_QUADS);
+  for (int q = 0; q < MAX_QUADS; ++q) {
+    const GLushort v = static_cast<GLushort>(4 * q);
+    const GLushort quadIdx[6] = { v, static_cast<GLushort>(v + 1), static_cast<GLushort>(v + 2),
+                                  v, static_cast<GLushort>(v + 2), static_cast<GLushort>(v + 3) };
+    copy(quadIdx, quadIdx + 6, &idx[6 * q]);
+  }
+  glBindVertexArray(vao_);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo_);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLushort) * idx.size(), &idx[0], GL_STATIC_DRAW);
+  safe_glEnableVertexAttribArray(h_aPosition_);
+  safe_glEnableVertexAttribArray(h_aTexCoord_);
+  safe_glEnableVertexAttribArray(h_aColor_);
+  glBindVertexArray(0);
+
+  vertices_.reserve(4 * MAX_QUADS);
+  checkGlErrors();
+}
+
+void Hud::begin(int windowWidth, int windowHeight) {
+  vertices_.clear();
+  windowWidth_ = max(windowWidth, 1);
+  windowHeight_ = max(windowHeight, 1);
+}
+
+void Hud::quad(float x0, float y0, float x1, float y1, float u0, float v0, float u1, float v1, unsigned color) {
+  if (vertices_.size() >= 4 * MAX_QUADS)
+    return;
+  const Vertex corner = { 0, 0, 0, 0, { static_cast<GLubyte>(color >> 24), static_cast<GLubyte>(color >> 16),
+                                        static_cast<GLubyte>(color >> 8), static_cast<GLubyte>(color) } };
+  Vertex v[4] = { corner, corner, corner, corner };
+  v[0].x = x0; v[0].y = y0; v[0].u = u0; v[0].v = v0;
+  v[1].x = x1; v[1].y = y0; v[1].u = u1; v[1].v = v0;
+  v[2].x = x1; v[2].y = y1; v[2].u = u1; v[2].v = v1;
+  v[3].x = x0; v[3].y = y1; v[3].u = u0; v[3].v = v1;
+  vertices_.insert(vertices_.end(), v, v + 4);
+}
+
+int Hud::text(int x, int y, const char* s, unsigned color, int scale) {
+  const float du = 1.0f / ATLAS_WIDTH, dv = 1.0f / ATLAS_HEIGHT;
+  for (; *s; ++s, x += GLYPH_WIDTH * scale) {
+    int c = toupper(static_cast<unsigned char>(*s)) - FONT_FIRST;
+    if (c == 0)
+      continue;   // nothing to draw for a space
+    if (c < 0 || c >= FONT_COUNT)
+      c = '?' - FONT_FIRST;
+    const int u = (c % ATLAS_COLUMNS) * GLYPH_WIDTH, v = (c / ATLAS_COLUMNS) * GLYPH_HEIGHT;
+    quad(static_cast<float>(x), static_cast<float>(y),
+         static_cast<float>(x + GLYPH_WIDTH * scale), static_cast<float>(y + GLYPH_HEIGHT * scale),
+         u * du, v * dv, (u + GLYPH_WIDTH) * du, (v + GLYPH_HEIGHT) * dv, color);
+  }
+  return x;
+}
+
+void Hud::rect(int x, int y, int w, int h, unsigned color) {
+  // the middle of the solid cell, so nearest filtering never reaches a neighbour
+  const float u = ((SOLID_CELL % ATLAS_COLUMNS) * GLYPH_WIDTH + 0.5f * GLYPH_WIDTH) / ATLAS_WIDTH;
+  const float v = ((SOLID_CELL / ATLAS_COLUMNS) * GLYPH_HEIGHT + 0.5f * GLYPH_HEIGHT) / ATLAS_HEIGHT;
+  quad(static_cast<float>(x), static_cast<float>(y), static_cast<float>(x + w), static_cast<float>(y + h),
+       u, v, u, v, color);
+}
+
+int Hud::graph(int x, int y, int w, int h, const float* values, int n, int first,
+               float maxValue, float limit, unsigned color, unsigned overColor) {
+  if (n <= 0 || maxValue <= 0)
+    return 0;
+  const float barWidth = static_cast<float>(w) / n;
+  const float u = ((SOLID_CELL % ATLAS_COLUMNS) * GLYPH_WIDTH + 0.5f * GLYPH_WIDTH) / ATLAS_WIDTH;
+  const float v = ((SOLID_CELL / ATLAS_COLUMNS) * GLYPH_HEIGHT + 0.5f * GLYPH_HEIGHT) / ATLAS_HEIGHT;
+  int over = 0;
+  for (int i = 0; i < n; ++i) {
+    const float value = values[(first + i) % n];
+    const float top = y + h - h * min(value / maxValue, 1.0f);
+    if (value > limit)
+      ++over;
+    quad(x + i * barWidth, top, x + (i + 1) * barWidth, static_cast<float>(y + h), u, v, u, v,
+         value > limit ? overColor : color);
+  }
+
+  // the limit as a line across
+  const float limitY = y + h - h * min(limit / maxValue, 1.0f);
+  quad(static_cast<float>(x), limitY, static_cast<float>(x + w), limitY + 1, u, v, u, v, overColor);
+  return over;
+}
+
+void Hud::draw(GlStateCache& state) {
+  if (vertices_.empty())
+    return;
+
+  vbo_.beginFrame();
+  GLintptr offset;
+  const GLsizeiptr size = sizeof(Vertex) * vertices_.size();
+  memcpy(vbo_.allocate(size, sizeof(Vertex), offset), &vertices_[0], size);
+  vbo_.flush();
+
+  state.useProgram(program_);
+  safe_glUniform2f(h_uPixelScale_, 2.0f / windowWidth_, 2.0f / windowHeight_);
+  safe_glUniform1i(h_uFont_, 0);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, atlas_);
+
+  state.bindVertexArray(vao_);
+  glBindBuffer(GL_ARRAY_BUFFER, vbo_);
+  const char* base = reinterpret_cast<const char*>(offset);
+  safe_glVertexAttribPointer(h_aPosition_, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), base + offsetof(Vertex, x));
+  safe_glVertexAttribPointer(h_aTexCoord_, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), base + offsetof(Vertex, u));
+  safe_glVertexAttribPointer(h_aColor_, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), base + offsetof(Vertex, color));
+
+  const GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST), blend = glIsEnabled(GL_BLEND);
+  glDisable(GL_DEPTH_TEST);
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+  glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(6 * numQuads()), GL_UNSIGNED_SHORT, 0);
+
+  if (depthTest)
+    glEnable(GL_DEPTH_TEST);
+  if (!blend)
+    glDisable(GL_BLEND);
+  vbo_.endFrame();
+}
@@ -0,0 +1,78 @@
+#ifndef HUD_H
+#define HUD_H
+
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "glsupport2.h"
+
+//--------------------------------------------------------------------------------
+// A text and rectangle overlay drawn on top of the frame
+//--------------------------------------------------------------------------------
+
+
+// Builds text, rectangles and bar graphs in window pixels from the top left
+// corner, then draws all of them as quads with one glDrawElements. Text uses a
+// 5x7 font baked into the source and uploaded once as a single channel atlas;
+// the atlas also holds a solid cell, so rectangles need no second texture or
+// shader. Lowercase prints as uppercase, characters the font lacks as '?'.
+// Quads past MAX_QUADS in a frame are dropped.
+//
+// Needs GL 3.1 for its shader.
+class Hud {
+public:
+  static const int MAX_QUADS = 2048;
+  static const int GLYPH_WIDTH = 6, GLYPH_HEIGHT = 8;   // pixels of a character cell at scale 1
+
+  // Packs a color as 0xRRGGBBAA
+  static unsigned rgba(int r, int g, int b, int a = 255) {
+    return (static_cast<unsigned>(r) << 24) | (static_cast<unsigned>(g) << 16) | (static_cast<unsigned>(b) << 8) | a;
+  }
+
+  Hud(const char* vsfn, const char* fsfn);
+
+  // Starts the quads of a frame drawn on a window of the given size
+  void begin(int windowWidth, int windowHeight);
+
+  // Adds a line of text with its top left at (x, y), every font pixel scale
+  // window pixels wide. Returns the x after its last character.
+  int text(int x, int y, const char* s, unsigned color, int scale = 1);
+
+  void rect(int x, int y, int w, int h, unsigned color);
+
+  // Adds a bar graph of the n values in a ring whose oldest entry is first,
+  // one bar per value over the width w, maxValue reaching the full height h.
+  // A bar above limit is drawn in overColor. Returns how many values were over.
+  int graph(int x, int y, int w, int h, const float* values, int n, int first,
+            float maxValue, float limit, unsigned color, unsigned overColor);
+
+  // Draws the quads of the frame over whatever is in the framebuffer. Binds
+  // its program and vertex array through state, and the atlas to texture
+  // unit 0; leaves depth testing and blending as it found them.
+  void draw(GlStateCache& state);
+
+  int numQuads() const {
+    return static_cast<int>(vertices_.size() / 4);
+  }
+
+private:
+  struct Vertex {
+    GLfloat x, y;
+    GLfloat u, v;
+    GLubyte color[4];
+  };
+
+  void quad(float x0, float y0, float x1, float y1, float u0, float v0, float u1, float v1, unsigned color);
+
+  GlProgram program_;
+  GLint h_uPixelScale_, h_uFont_, h_aPosition_, h_aTexCoord_, h_aColor_;
+  GlTexture atlas_;
+  GlVertexArrayObject vao_;
+  GlBufferObject ibo_;
+  StreamBuffer vbo_;
+  std::vector<Vertex> vertices_;   // of the frame being built
+  int windowWidth_, windowHeight_;
+};
+
+#endif
@@ -0,0 +1,132 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//--------------------------------------------------------------------------------
+// A pool of worker threads running data parallel loops
+//--------------------------------------------------------------------------------
+
+
+// Keeps numThreads - 1 workers parked between jobs, so a parallel loop run
+// every frame costs a wake up rather than thread creation. The calling thread
+// takes part in every loop. Chunks are handed out through an atomic counter,
+// so uneven chunks balance themselves. Only one thread may submit at a time.
+class JobSystem {
+public:
+  // numThreads counts the caller; 0 for one per hardware thread
+  explicit JobSystem(int numThreads = 0)
+    : job_(NULL), n_(0), grain_(1), next_(0), busy_(0), generation_(0), stop_(false) {
+    if (numThreads <= 0)
+      numThreads = std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+    for (int i = 1; i < numThreads; ++i)
+      workers_.push_back(std::thread(&JobSystem::work, this));
+  }
+
+  ~JobSystem() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    wake_.notify_all();
+    for (size_t i = 0; i < workers_.size(); ++i)
+      workers_[i].join();
+  }
+
+  int numThreads() const {
+    return static_cast<int>(workers_.size()) + 1;
+  }
+
+  // Calls fn(begin, end) over [0, n) in chunks of grain items and returns
+  // once all are done. An exception thrown by fn skips the chunks not started
+  // yet and is rethrown here.
+  template<typename Fn>
+  void parallelFor(int n, int grain, const Fn& fn) {
+    grain = std::max(grain, 1);
+    if (n <= grain || workers_.empty()) {
+      if (n > 0)
+        fn(0, n);
+      return;
+    }
+
+    const std::function<void(int, int)> job(fn);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      job_ = &job;
+      n_ = n;
+      grain_ = grain;
+      next_ = 0;
+      busy_ = static_cast<int>(workers_.size());
+      error_ = std::exception_ptr();
+      ++generation_;
+    }
+    wake_.notify_all();
+
+    runChunks();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this]() { return busy_ == 0; });
+    job_ = NULL;
+    if (error_)
+      std::rethrow_exception(error_);
+  }
+
+private:
+  void work() {
+    unsigned long long seen = 0;
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+      wake_.wait(lock, [this, seen]() { return stop_ || generation_ != seen; });
+      if (stop_)
+        return;
+      seen = generation_;
+
+      lock.unlock();
+      runChunks();
+      lock.lock();
+
+      if (--busy_ == 0)
+        done_.notify_one();
+    }
+  }
+
+  void runChunks() {
+    for (;;) {
+      const int begin = next_.fetch_add(grain_);
+      if (begin >= n_)
+        return;
+      try {
+        (*job_)(begin, std::min(begin + grain_, n_));
+      }
+      catch (...) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!error_)
+          error_ = std::current_exception();
+        next_ = n_;
+      }
+    }
+  }
+
+  std::vector<std::thread> workers_;
+
+  // the current loop, set under mutex_ before generation_ moves on
+  const std::function<void(int, int)>* job_;
+  int n_, grain_;
+  std::atomic<int> next_;
+
+  std::mutex mutex_;
+  std::condition_variable wake_, done_;
+  int busy_;                          // workers not done with the current loop
+  unsigned long long generation_;     // of the current loop
+  bool stop_;
+  std::exception_ptr error_;
+};
+
+#endif
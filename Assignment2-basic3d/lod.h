@@ -0,0 +1,72 @@
+#ifndef LOD_H
+#define LOD_H
+
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+#include "cvec.h"
+
+//--------------------------------------------------------------------------------
+// Level of detail selection by projected screen size
+//--------------------------------------------------------------------------------
+
+
+// Returns the diameter in pixels of a sphere of the given radius seen at the
+// given distance, by a perspective camera with vertical field of view fovY
+// (degrees) and a viewport viewportHeight pixels high
+inline double projectedSize(double radius, double distance, double fovY, int viewportHeight) {
+  if (distance <= radius)
+    return 1e30;
+  const double halfAngle = fovY * 0.5 * CS175_PI / 180.0;
+  return radius * viewportHeight / (distance * std::tan(halfAngle));
+}
+
+// A chain of representations of one object, level 0 being the finest. Level i
+// is good enough while the object covers at least minSize(i) pixels; the last
+// level is used below that.
+class LodChain {
+  std::vector<double> minSize_;   // decreasing
+  double hysteresis_;
+
+public:
+  // hysteresis is the relative band around each threshold in which the
+  // current level is kept, so objects near a threshold do not flicker
+  explicit LodChain(double hysteresis = 0.15) : hysteresis_(hysteresis) {}
+
+  // Appends the next coarser level, used down to minSize pixels
+  void addLevel(double minSize) {
+    assert(minSize_.empty() || minSize < minSize_.back());
+    minSize_.push_back(minSize);
+  }
+
+  int numLevels() const {
+    return static_cast<int>(minSize_.size());
+  }
+
+  double minSize(int level) const {
+    return minSize_[level];
+  }
+
+  // Returns the level for an object covering size pixels, that last used
+  // current (or -1 if it was not drawn)
+  int select(double size, int current) const {
+    const int last = numLevels() - 1;
+    int level = last;
+    for (int i = 0; i < last; ++i) {
+      if (size >= minSize_[i]) {
+        level = i;
+        break;
+      }
+    }
+    if (current < 0 || current > last || level == current)
+      return level;
+
+    // only leave the current level once size is clearly past its threshold
+    if (level < current)
+      return size >= minSize_[current - 1] * (1 + hysteresis_) ? level : current;
+    return size < minSize_[current] * (1 - hysteresis_) ? level : current;
+  }
+};
+
+#endif
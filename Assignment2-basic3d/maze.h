@@ -0,0 +1,114 @@
+#ifndef MAZE_H
+#define MAZE_H
+
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+//--------------------------------------------------------------------------------
+// Seeded generation of perfect mazes on a grid of cells
+//--------------------------------------------------------------------------------
+
+
+// splitmix64, so a seed gives the same maze on every platform and build,
+// unlike the distributions of <random>
+class MazeRandom {
+  unsigned long long state_;
+
+public:
+  explicit MazeRandom(unsigned long long seed) : state_(seed) {}
+
+  unsigned long long next() {
+    unsigned long long z = (state_ += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+  }
+
+  // Uniform in [0, n), n small
+  int below(int n) {
+    return static_cast<int>(next() % static_cast<unsigned long long>(n));
+  }
+};
+
+// A straight run of wall on the lines of the grid: from corner (x, z) over
+// length cells along x, or along z
+struct MazeWall {
+  int x, z;
+  int length;
+  bool alongX;
+};
+
+// Carves a perfect maze (exactly one path between any two cells) into n x m
+// cells with a randomized depth first search from cell (0, 0), and returns
+// the walls left standing, the outer boundary included. The boundary on the
+// z = 0 side of cell (entrance, 0) is left open. Collinear neighbouring
+// walls are joined into runs of at most maxLength cells. The walls come out
+// in a fixed order, first those along x by row, then those along z by column.
+inline std::vector<MazeWall> makeMaze(int n, int m, unsigned long long seed, int entrance = 0, int maxLength = 2) {
+  assert(n > 0 && m > 0 && maxLength > 0);
+
+  // wallX[j * n + i]: wall on the z = j line over cell column i, j in [0, m]
+  // wallZ[i * m + j]: wall on the x = i line over cell row j, i in [0, n]
+  std::vector<char> wallX(static_cast<size_t>(n) * (m + 1), 1), wallZ(static_cast<size_t>(m) * (n + 1), 1);
+  std::vector<char> visited(static_cast<size_t>(n) * m, 0);
+  std::vector<int> stack;
+  MazeRandom random(seed);
+
+  visited[0] = 1;
+  stack.push_back(0);
+  while (!stack.empty()) {
+    const int cell = stack.back(), i = cell % n, j = cell / n;
+    int next[4], numNext = 0;
+    if (i > 0 && !visited[cell - 1]) next[numNext++] = 0;
+    if (i + 1 < n && !visited[cell + 1]) next[numNext++] = 1;
+    if (j > 0 && !visited[cell - n]) next[numNext++] = 2;
+    if (j + 1 < m && !visited[cell + n]) next[numNext++] = 3;
+    if (numNext == 0) {
+      stack.pop_back();
+      continue;
+    }
+
+    int to;
+    switch (next[random.below(numNext)]) {
+    case 0: wallZ[static_cast<size_t>(i) * m + j] = 0; to = cell - 1; break;
+    case 1: wallZ[static_cast<size_t>(i + 1) * m + j] = 0; to = cell + 1; break;
+    case 2: wallX[static_cast<size_t>(j) * n + i] = 0; to = cell - n; break;
+    default: wallX[static_cast<size_t>(j + 1) * n + i] = 0; to = cell + n; break;
+    }
+    visited[to] = 1;
+    stack.push_back(to);
+  }
+  if (entrance >= 0 && entrance < n)
+    wallX[entrance] = 0;
+
+  // join the standing walls of every grid line into runs
+  std::vector<MazeWall> walls;
+  for (int j = 0; j <= m; ++j) {
+    for (int i = 0; i < n;) {
+      if (!wallX[static_cast<size_t>(j) * n + i]) {
+        ++i;
+        continue;
+      }
+      MazeWall w = { i, j, 0, true };
+      while (i < n && w.length < maxLength && wallX[static_cast<size_t>(j) * n + i])
+        ++w.length, ++i;
+      walls.push_back(w);
+    }
+  }
+  for (int i = 0; i <= n; ++i) {
+    for (int j = 0; j < m;) {
+      if (!wallZ[static_cast<size_t>(i) * m + j]) {
+        ++j;
+        continue;
+      }
+      MazeWall w = { i, j, 0, false };
+      while (j < m && w.length < maxLength && wallZ[static_cast<size_t>(i) * m + j])
+        ++w.length, ++j;
+      walls.push_back(w);
+    }
+  }
+  return walls;
+}
+
+#endif
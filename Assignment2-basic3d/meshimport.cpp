@@ -0,0 +1,682 @@
+#include <algorithm>
+#include <cctype>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <exception>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "meshimport.h"
+#include "scenefile.h"
+#include "profiler.h"
+
+using namespace std;
+
+static const size_t MIN_BYTES_PER_THREAD = 1 << 20;
+static const size_t MIN_VERTICES_PER_THREAD = 1 << 16;
+
+static int threadCount(int maxThreads, size_t work, size_t minWorkPerThread) {
+  const int n = maxThreads > 0 ? maxThreads : static_cast<int>(thread::hardware_concurrency());
+  return static_cast<int>(max<size_t>(1, min<size_t>(max(n, 1), work / minWorkPerThread)));
+}
+
+// Runs fn(t) for every t in [0, numThreads), each on its own thread, and
+// rethrows the first exception any of them threw
+template<typename Fn>
+static void runThreads(int numThreads, const Fn& fn) {
+  if (numThreads == 1) {
+    fn(0);
+    return;
+  }
+  vector<exception_ptr> errors(numThreads);
+  vector<thread> threads;
+  for (int t = 0; t < numThreads; ++t) {
+    threads.push_back(thread([&fn, &errors, t]() {
+      try {
+        fn(t);
+      }
+      catch (...) {
+        errors[t] = current_exception();
+      }
+    }));
+  }
+  for (size_t t = 0; t < threads.size(); ++t)
+    threads[t].join();
+  for (size_t t = 0; t < errors.size(); ++t) {
+    if (errors[t])
+      rethrow_exception(errors[t]);
+  }
+}
+
+// Area weighted vertex normals of a triangle list
+static void computeNormals(vector<GenericVertex>& vtx, const vector<unsigned>& idx) {
+  vector<Cvec3f> normals(vtx.size(), Cvec3f(0, 0, 0));
+  for (size_t i = 0; i + 2 < idx.size(); i += 3) {
+    const Cvec3f& a = vtx[idx[i]].pos;
+    const Cvec3f e1 = vtx[idx[i + 1]].pos - a, e2 = vtx[idx[i + 2]].pos - a;
+    const Cvec3f n(e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]);
+    for (int k = 0; k < 3; ++k)
+      normals[idx[i + k]] += n;
+  }
+  for (size_t i = 0; i < vtx.size(); ++i) {
+    const float len = norm(normals[i]);
+    vtx[i].normal = len > 0 ? normals[i] / len : Cvec3f(0, 1, 0);
+  }
+}
+
+// Triangulates the polygon corners[0..n) as a fan into out
+template<typename T>
+static void appendFan(const T* corners, size_t n, vector<T>& out) {
+  for (size_t k = 1; k + 1 < n; ++k) {
+    out.push_back(corners[0]);
+    out.push_back(corners[k]);
+    out.push_back(corners[k + 1]);
+  }
+}
+
+
+// ---------------- Number parsing
+
+static inline bool isDigit(char c) {
+  return static_cast<unsigned>(c - '0') < 10;
+}
+
+static inline const char* skipSpace(const char* p, const char* end) {
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+    ++p;
+  return p;
+}
+
+// Parses a decimal floating point number at p, without the locale lookups and
+// NUL termination strtod needs. The first 19 significant digits are kept and
+// scaled by one power of ten, which is exact to well within a float. Like
+// strtof, values beyond the float range become infinity. Returns the end of
+// the number, or p if there is none.
+static const char* parseFloat(const char* p, const char* end, float& out) {
+  static const double powers[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+  };
+
+  const char* s = p;
+  bool negative = false;
+  if (s < end && (*s == '-' || *s == '+'))
+    negative = *s++ == '-';
+
+  unsigned long long mantissa = 0;
+  int digits = 0, exponent = 0;
+  bool any = false;
+  for (; s < end && isDigit(*s); ++s, any = true) {
+    if (digits < 19) {
+      mantissa = mantissa * 10 + (*s - '0');
+      digits += mantissa != 0;
+    }
+    else {
+      ++exponent;
+    }
+  }
+  if (s < end && *s == '.') {
+    for (++s; s < end && isDigit(*s); ++s, any = true) {
+      if (digits < 19) {
+        mantissa = mantissa * 10 + (*s - '0');
+        digits += mantissa != 0;
+        --exponent;
+      }
+    }
+  }
+  if (!any)
+    return p;
+
+  if (s < end && (*s == 'e' || *s == 'E')) {
+    const char* e = s + 1;
+    bool negativeExponent = false;
+    if (e < end && (*e == '-' || *e == '+'))
+      negativeExponent = *e++ == '-';
+    if (e < end && isDigit(*e)) {
+      int x = 0;
+      for (; e < end && isDigit(*e); ++e)
+        x = min(x * 10 + (*e - '0'), 10000);
+      exponent += negativeExponent ? -x : x;
+      s = e;
+    }
+  }
+
+  // zero stays zero whatever the exponent, 0e400 is not 0 * inf
+  if (mantissa == 0) {
+    out = negative ? -0.0f : 0.0f;
+    return s;
+  }
+
+  double v = static_cast<double>(mantissa);
+  if (exponent < 0)
+    v = exponent >= -22 ? v / powers[-exponent] : v * pow(10.0, exponent);
+  else if (exponent > 0)
+    v = exponent <= 22 ? v * powers[exponent] : v * pow(10.0, exponent);
+  if (v > FLT_MAX)
+    v = HUGE_VAL;   // converting a finite double past the float range is undefined
+  out = static_cast<float>(negative ? -v : v);
+  return s;
+}
+
+// Returns the end of the integer at p, or p if there is none
+static const char* parseInt(const char* p, const char* end, int& out) {
+  const char* s = p;
+  bool negative = false;
+  if (s < end && (*s == '-' || *s == '+'))
+    negative = *s++ == '-';
+  if (s == end || !isDigit(*s))
+    return p;
+  long long v = 0;
+  for (; s < end && isDigit(*s); ++s)
+    v = min(v * 10 + (*s - '0'), static_cast<long long>(INT_MAX));
+  out = static_cast<int>(negative ? -v : v);
+  return s;
+}
+
+
+// ---------------- Wavefront OBJ
+
+// A face corner: position, texture coordinate and normal index, each 0-based
+// or OBJ_ABSENT. Negative OBJ indices count back from the current line, so
+// while a chunk is parsed they are relative to the chunk's own first entry,
+// marked by the bits of relative.
+struct ObjCorner {
+  int v[3];
+  unsigned char relative;
+};
+
+static const int OBJ_ABSENT = INT_MIN;
+
+struct ObjChunk {
+  vector<float> pos, tex, normal;   // 3, 2 and 3 floats per entry
+  vector<ObjCorner> corners;        // 3 per triangle
+};
+
+// Parses up to n floats, at least required of them, and appends them to out,
+// padded with zeros to n
+static const char* parseObjFloats(const char* p, const char* end, int n, int required, vector<float>& out) {
+  for (int k = 0; k < n; ++k) {
+    p = skipSpace(p, end);
+    float f = 0;
+    const char* q = parseFloat(p, end, f);
+    if (q == p && k < required)
+      throw runtime_error("Bad number in OBJ file");
+    out.push_back(f);
+    p = q;
+  }
+  return p;
+}
+
+// Parses the v, vt, vn and f lines of [p, end), which starts at a line
+static void parseObjChunk(const char* p, const char* end, ObjChunk& chunk) {
+  vector<ObjCorner> face;
+  while (p < end) {
+    const char* line = skipSpace(p, end);
+    const char* eol = static_cast<const char*>(memchr(line, '\n', end - line));
+    if (!eol)
+      eol = end;
+    p = eol < end ? eol + 1 : end;
+    if (eol - line < 2)
+      continue;
+
+    const char c0 = line[0], c1 = line[1];
+    const bool space1 = c1 == ' ' || c1 == '\t';
+    if (c0 == 'v' && space1) {
+      parseObjFloats(line + 2, eol, 3, 3, chunk.pos);
+    }
+    else if (c0 == 'v' && c1 == 't' && eol - line > 2) {
+      parseObjFloats(line + 3, eol, 2, 1, chunk.tex);
+    }
+    else if (c0 == 'v' && c1 == 'n' && eol - line > 2) {
+      parseObjFloats(line + 3, eol, 3, 3, chunk.normal);
+    }
+    else if (c0 == 'f' && space1) {
+      const int counts[3] = {
+        static_cast<int>(chunk.pos.size() / 3), static_cast<int>(chunk.tex.size() / 2),
+        static_cast<int>(chunk.normal.size() / 3)
+      };
+      face.clear();
+      const char* s = skipSpace(line + 2, eol);
+      while (s < eol) {
+        // v, v/t, v//n or v/t/n
+        ObjCorner corner;
+        corner.v[0] = corner.v[1] = corner.v[2] = OBJ_ABSENT;
+        corner.relative = 0;
+        for (int k = 0; k < 3; ++k) {
+          if (k > 0) {
+            if (s == eol || *s != '/')
+              break;
+            ++s;
+          }
+          int i = 0;
+          const char* q = parseInt(s, eol, i);
+          if (q == s) {
+            if (k == 0)
+              throw runtime_error("Bad face in OBJ file");
+            continue;
+          }
+          if (i == 0)
+            throw runtime_error("Bad face in OBJ file");
+          if (i > 0) {
+            corner.v[k] = i - 1;
+          }
+          else {
+            corner.v[k] = counts[k] + i;
+            corner.relative |= 1 << k;
+          }
+          s = q;
+        }
+        if (s < eol && *s != ' ' && *s != '\t' && *s != '\r')
+          throw runtime_error("Bad face in OBJ file");
+        face.push_back(corner);
+        s = skipSpace(s, eol);
+      }
+      if (face.size() >= 3)
+        appendFan(&face[0], face.size(), chunk.corners);
+    }
+  }
+}
+
+// Open addressing map from the resolved indices of a corner to its vertex
+class CornerTable {
+  struct Slot {
+    int v[3];          // v[0] < 0 for an empty slot
+    unsigned vertex;
+  };
+  vector<Slot> slots_;
+  size_t size_;
+
+  static size_t hash(const int v[3]) {
+    unsigned h = static_cast<unsigned>(v[0]) * 0x9e3779b1u;
+    h ^= static_cast<unsigned>(v[1]) * 0x85ebca77u;
+    h ^= static_cast<unsigned>(v[2]) * 0xc2b2ae3du;
+    return h ^ (h >> 15);
+  }
+
+  void rehash(size_t capacity) {
+    vector<Slot> old;
+    old.swap(slots_);
+    Slot empty;
+    empty.v[0] = -1;
+    slots_.assign(capacity, empty);
+    for (size_t i = 0; i < old.size(); ++i) {
+      if (old[i].v[0] >= 0)
+        slots_[probe(old[i].v)] = old[i];
+    }
+  }
+
+  size_t probe(const int v[3]) const {
+    const size_t mask = slots_.size() - 1;
+    for (size_t i = hash(v) & mask;; i = (i + 1) & mask) {
+      const Slot& s = slots_[i];
+      if (s.v[0] < 0 || (s.v[0] == v[0] && s.v[1] == v[1] && s.v[2] == v[2]))
+        return i;
+    }
+  }
+
+public:
+  explicit CornerTable(size_t expected) : size_(0) {
+    size_t capacity = 16;
+    while (capacity < expected * 2)
+      capacity *= 2;
+    rehash(capacity);
+  }
+
+  // Returns the vertex of the corner v, which becomes next if it is new
+  unsigned insert(const int v[3], unsigned next, bool& inserted) {
+    if ((size_ + 1) * 2 > slots_.size())
+      rehash(slots_.size() * 2);
+    Slot& s = slots_[probe(v)];
+    inserted = s.v[0] < 0;
+    if (inserted) {
+      memcpy(s.v, v, sizeof(s.v));
+      s.vertex = next;
+      ++size_;
+    }
+    return s.vertex;
+  }
+};
+
+ImportedMesh importObj(const char* filename, int maxThreads) {
+  const MappedFile file(filename);
+  const char* data = reinterpret_cast<const char*>(file.data());
+  const size_t size = file.size();
+
+  // chunks of whole lines
+  const int numThreads = threadCount(maxThreads, size, MIN_BYTES_PER_THREAD);
+  vector<const char*> bounds(numThreads + 1, data + size);
+  bounds[0] = data;
+  for (int t = 1; t < numThreads; ++t) {
+    const char* p = max(bounds[t - 1], data + size * t / numThreads);
+    const char* eol = static_cast<const char*>(memchr(p, '\n', data + size - p));
+    bounds[t] = eol ? eol + 1 : data + size;
+  }
+
+  vector<ObjChunk> chunks(numThreads);
+  runThreads(numThreads, [&](int t) {
+    parseObjChunk(bounds[t], bounds[t + 1], chunks[t]);
+  });
+
+  // concatenate the attributes, remembering where each chunk's start
+  vector<float> attribs[3];
+  const int widths[3] = { 3, 2, 3 };
+  vector<int> bases[3];
+  size_t numCorners = 0;
+  for (int k = 0; k < 3; ++k) {
+    size_t total = 0;
+    for (int t = 0; t < numThreads; ++t) {
+      const vector<float>& a = k == 0 ? chunks[t].pos : k == 1 ? chunks[t].tex : chunks[t].normal;
+      total += a.size();
+    }
+    if (total / widths[k] > static_cast<size_t>(INT_MAX))
+      throw runtime_error(string("Too many vertices in ") + filename);
+    attribs[k].reserve(total);
+    for (int t = 0; t < numThreads; ++t) {
+      vector<float>& a = k == 0 ? chunks[t].pos : k == 1 ? chunks[t].tex : chunks[t].normal;
+      bases[k].push_back(static_cast<int>(attribs[k].size() / widths[k]));
+      attribs[k].insert(attribs[k].end(), a.begin(), a.end());
+      vector<float>().swap(a);
+    }
+  }
+  for (int t = 0; t < numThreads; ++t)
+    numCorners += chunks[t].corners.size();
+  const int counts[3] = {
+    static_cast<int>(attribs[0].size() / 3), static_cast<int>(attribs[1].size() / 2),
+    static_cast<int>(attribs[2].size() / 3)
+  };
+
+  // one vertex per distinct corner
+  ImportedMesh mesh;
+  mesh.idx.reserve(numCorners);
+  mesh.vtx.reserve(counts[0]);
+  CornerTable table(counts[0]);
+  bool allNormals = true;
+  for (int t = 0; t < numThreads; ++t) {
+    const vector<ObjCorner>& corners = chunks[t].corners;
+    for (size_t i = 0; i < corners.size(); ++i) {
+      int v[3];
+      for (int k = 0; k < 3; ++k) {
+        v[k] = corners[i].v[k];
+        if (v[k] == OBJ_ABSENT) {
+          v[k] = -1;
+          continue;
+        }
+        if (corners[i].relative & (1 << k))
+          v[k] += bases[k][t];
+        if (v[k] < 0 || v[k] >= counts[k])
+          throw runtime_error(string("Index out of range in ") + filename);
+      }
+
+      bool inserted;
+      const unsigned vertex = table.insert(v, static_cast<unsigned>(mesh.vtx.size()), inserted);
+      if (inserted) {
+        const float* p = &attribs[0][3 * v[0]];
+        const float* tex = v[1] >= 0 ? &attribs[1][2 * v[1]] : NULL;
+        const float* n = v[2] >= 0 ? &attribs[2][3 * v[2]] : NULL;
+        mesh.vtx.push_back(GenericVertex(p[0], p[1], p[2], n ? n[0] : 0, n ? n[1] : 0, n ? n[2] : 0,
+                                         tex ? tex[0] : 0, tex ? tex[1] : 0, 0, 0, 0, 0, 0, 0));
+        mesh.hasTexCoords |= tex != NULL;
+        allNormals &= n != NULL;
+      }
+      mesh.idx.push_back(vertex);
+    }
+    vector<ObjCorner>().swap(chunks[t].corners);
+  }
+
+  mesh.hasNormals = allNormals && !mesh.vtx.empty();
+  if (!mesh.hasNormals)
+    computeNormals(mesh.vtx, mesh.idx);
+  return mesh;
+}
+
+
+// ---------------- Binary PLY
+
+enum PlyType { PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16, PLY_INT32, PLY_UINT32, PLY_FLOAT32, PLY_FLOAT64 };
+
+static const size_t plyTypeSizes[] = { 1, 1, 2, 2, 4, 4, 4, 8 };
+
+struct PlyProperty {
+  string name;
+  PlyType type;
+  PlyType countType;   // of a list
+  bool list;
+};
+
+struct PlyElement {
+  string name;
+  size_t count;
+  vector<PlyProperty> props;
+};
+
+static PlyType plyType(const string& name) {
+  static const char* const names[][2] = {
+    { "char", "int8" }, { "uchar", "uint8" }, { "short", "int16" }, { "ushort", "uint16" },
+    { "int", "int32" }, { "uint", "uint32" }, { "float", "float32" }, { "double", "float64" }
+  };
+  for (int i = 0; i < 8; ++i) {
+    if (name == names[i][0] || name == names[i][1])
+      return static_cast<PlyType>(i);
+  }
+  throw runtime_error("Unknown PLY property type " + name);
+}
+
+static double readPly(const unsigned char* p, PlyType type, bool swap) {
+  unsigned char b[8];
+  const size_t size = plyTypeSizes[type];
+  for (size_t i = 0; i < size; ++i)
+    b[i] = swap ? p[size - 1 - i] : p[i];
+
+  switch (type) {
+  case PLY_INT8: return static_cast<signed char>(b[0]);
+  case PLY_UINT8: return b[0];
+  case PLY_INT16: { short v; memcpy(&v, b, 2); return v; }
+  case PLY_UINT16: { unsigned short v; memcpy(&v, b, 2); return v; }
+  case PLY_INT32: { int v; memcpy(&v, b, 4); return v; }
+  case PLY_UINT32: { unsigned v; memcpy(&v, b, 4); return v; }
+  case PLY_FLOAT32: { float v; memcpy(&v, b, 4); return v; }
+  default: { double v; memcpy(&v, b, 8); return v; }
+  }
+}
+
+// Index of the ImportedMesh attribute a vertex property fills: 0..2 position,
+// 3..5 normal, 6..7 texture coordinate, -1 for none
+static int plyAttribute(const string& name) {
+  static const char* const names[][4] = {
+    { "x" }, { "y" }, { "z" }, { "nx" }, { "ny" }, { "nz" },
+    { "u", "s", "texture_u", "texture_s" }, { "v", "t", "texture_v", "texture_t" }
+  };
+  for (int a = 0; a < 8; ++a) {
+    for (int i = 0; i < 4 && names[a][i]; ++i) {
+      if (name == names[a][i])
+        return a;
+    }
+  }
+  return -1;
+}
+
+ImportedMesh importPly(const char* filename, int maxThreads) {
+  const MappedFile file(filename);
+  const unsigned char* data = file.data();
+  const unsigned char* const end = data + file.size();
+
+  // the ASCII header, up to and including the end_header line
+  const char* text = reinterpret_cast<const char*>(data);
+  const char* headerEnd = NULL;
+  for (const char* p = text; p + 10 <= reinterpret_cast<const char*>(end); ++p) {
+    if (memcmp(p, "end_header", 10) == 0 && (p == text || p[-1] == '\n')) {
+      headerEnd = static_cast<const char*>(memchr(p, '\n', reinterpret_cast<const char*>(end) - p));
+      break;
+    }
+  }
+  if (file.size() < 4 || memcmp(text, "ply", 3) != 0 || !headerEnd)
+    throw runtime_error(string("Not a PLY file: ") + filename);
+
+  istringstream header(string(text, headerEnd));
+  string line;
+  bool bigEndian = false;
+  vector<PlyElement> elements;
+  getline(header, line);
+  while (getline(header, line)) {
+    istringstream words(line);
+    string keyword;
+    words >> keyword;
+    if (keyword == "format") {
+      string format;
+      words >> format;
+      if (format == "binary_big_endian")
+        bigEndian = true;
+      else if (format != "binary_little_endian")
+        throw runtime_error(string("Only binary PLY files are supported: ") + filename);
+    }
+    else if (keyword == "element") {
+      PlyElement e;
+      words >> e.name >> e.count;
+      elements.push_back(e);
+    }
+    else if (keyword == "property") {
+      if (elements.empty())
+        throw runtime_error(string("Property outside an element in ") + filename);
+      PlyProperty prop;
+      string type;
+      words >> type;
+      prop.list = type == "list";
+      if (prop.list) {
+        string countType;
+        words >> countType >> type;
+        prop.countType = plyType(countType);
+      }
+      prop.type = plyType(type);
+      words >> prop.name;
+      elements.back().props.push_back(prop);
+    }
+  }
+
+  const unsigned one = 1;
+  const bool swap = bigEndian == (*reinterpret_cast<const unsigned char*>(&one) == 1);
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(headerEnd) + 1;
+  const string truncated = string("Truncated PLY file ") + filename;
+
+  ImportedMesh mesh;
+  bool haveFaces = false;
+  for (size_t e = 0; e < elements.size(); ++e) {
+    const PlyElement& element = elements[e];
+    size_t stride = 0;
+    bool fixed = true;
+    for (size_t i = 0; i < element.props.size(); ++i) {
+      stride += plyTypeSizes[element.props[i].type];
+      fixed &= !element.props[i].list;
+    }
+
+    if (element.name == "vertex") {
+      if (!fixed)
+        throw runtime_error(string("List property in the vertices of ") + filename);
+      if (element.count > static_cast<size_t>(end - p) / max<size_t>(stride, 1))
+        throw runtime_error(truncated);
+
+      // where each attribute is in a vertex
+      int offsets[8], found = 0;
+      PlyType types[8];
+      fill(offsets, offsets + 8, -1);
+      for (size_t i = 0, offset = 0; i < element.props.size(); offset += plyTypeSizes[element.props[i].type], ++i) {
+        const int a = plyAttribute(element.props[i].name);
+        if (a >= 0) {
+          offsets[a] = static_cast<int>(offset);
+          types[a] = element.props[i].type;
+          found |= 1 << a;
+        }
+      }
+      if ((found & 7) != 7)
+        throw runtime_error(string("Vertices without positions in ") + filename);
+      mesh.hasNormals = (found & 0x38) == 0x38;
+      mesh.hasTexCoords = (found & 0xc0) == 0xc0;
+
+      // fixed size records, so ranges of vertices decode independently
+      mesh.vtx.assign(element.count, GenericVertex(0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0));
+      const unsigned char* base = p;
+      const int numThreads = threadCount(maxThreads, element.count, MIN_VERTICES_PER_THREAD);
+      runThreads(numThreads, [&](int t) {
+        const size_t begin = element.count * t / numThreads, last = element.count * (t + 1) / numThreads;
+        for (size_t i = begin; i < last; ++i) {
+          const unsigned char* r = base + i * stride;
+          float a[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+          for (int k = 0; k < 8; ++k) {
+            if (offsets[k] >= 0)
+              a[k] = static_cast<float>(readPly(r + offsets[k], types[k], swap));
+          }
+          GenericVertex& v = mesh.vtx[i];
+          v.pos = Cvec3f(a[0], a[1], a[2]);
+          v.normal = Cvec3f(a[3], a[4], a[5]);
+          v.tex = Cvec2f(a[6], a[7]);
+        }
+      });
+      p += element.count * stride;
+      continue;
+    }
+
+    if (fixed && element.name != "face") {
+      if (element.count > static_cast<size_t>(end - p) / max<size_t>(stride, 1))
+        throw runtime_error(truncated);
+      p += element.count * stride;
+      continue;
+    }
+
+    // variable size records are walked one by one
+    const bool faces = element.name == "face";
+    vector<unsigned> polygon;
+    for (size_t f = 0; f < element.count; ++f) {
+      for (size_t i = 0; i < element.props.size(); ++i) {
+        const PlyProperty& prop = element.props[i];
+        size_t n = 1;
+        if (prop.list) {
+          if (plyTypeSizes[prop.countType] > static_cast<size_t>(end - p))
+            throw runtime_error(truncated);
+          n = static_cast<size_t>(readPly(p, prop.countType, swap));
+          p += plyTypeSizes[prop.countType];
+        }
+        const size_t size = plyTypeSizes[prop.type];
+        if (n > static_cast<size_t>(end - p) / size)
+          throw runtime_error(truncated);
+
+        if (faces && prop.list && (prop.name == "vertex_indices" || prop.name == "vertex_index")) {
+          polygon.clear();
+          for (size_t k = 0; k < n; ++k) {
+            const double index = readPly(p + k * size, prop.type, swap);
+            if (index < 0 || index >= static_cast<double>(mesh.vtx.size()))
+              throw runtime_error(string("Index out of range in ") + filename);
+            polygon.push_back(static_cast<unsigned>(index));
+          }
+          if (polygon.size() >= 3)
+            appendFan(&polygon[0], polygon.size(), mesh.idx);
+          haveFaces = true;
+        }
+        p += n * size;
+      }
+    }
+  }
+
+  if (!haveFaces)
+    throw runtime_error(string("No faces in ") + filename);
+  if (!mesh.hasNormals)
+    computeNormals(mesh.vtx, mesh.idx);
+  return mesh;
+}
+
+ImportedMesh importMesh(const char* filename, int maxThreads) {
+  PROFILE_SCOPE("importMesh");
+  string extension(filename);
+  const size_t dot = extension.rfind('.');
+  extension = dot == string::npos ? "" : extension.substr(dot + 1);
+  for (size_t i = 0; i < extension.size(); ++i)
+    extension[i] = static_cast<char>(tolower(static_cast<unsigned char>(extension[i])));
+
+  if (extension == "obj")
+    return importObj(filename, maxThreads);
+  if (extension == "ply")
+    return importPly(filename, maxThreads);
+  throw runtime_error(string("Unknown mesh format: ") + filename);
+}
@@ -0,0 +1,35 @@
+#ifndef MESHIMPORT_H
+#define MESHIMPORT_H
+
+#include <vector>
+
+#include "geometrymaker.h"
+
+//--------------------------------------------------------------------------------
+// Importers for Wavefront OBJ and binary PLY meshes
+//--------------------------------------------------------------------------------
+
+
+// An indexed triangle list. Polygons are triangulated as fans, and the normals
+// are computed from the triangles when the file has none. Tangents and
+// binormals are left zero.
+struct ImportedMesh {
+  std::vector<GenericVertex> vtx;
+  std::vector<unsigned> idx;
+  bool hasNormals, hasTexCoords;   // whether the file gave them
+
+  ImportedMesh() : hasNormals(false), hasTexCoords(false) {}
+};
+
+// The file is mapped and split into chunks of whole lines (OBJ) or vertex
+// ranges (PLY) parsed on up to maxThreads threads, 0 for the hardware
+// concurrency. OBJ corners are deduplicated into one vertex per distinct
+// position/texture coordinate/normal triple. Both throw runtime_error on
+// malformed input.
+ImportedMesh importObj(const char* filename, int maxThreads = 0);
+ImportedMesh importPly(const char* filename, int maxThreads = 0);
+
+// Picks the importer by the extension of filename
+ImportedMesh importMesh(const char* filename, int maxThreads = 0);
+
+#endif
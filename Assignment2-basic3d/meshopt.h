@@ -0,0 +1,296 @@
+#ifndef MESHOPT_H
+#define MESHOPT_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "cvec.h"
+
+//--------------------------------------------------------------------------------
+// Index and vertex buffer reordering for the post-transform vertex cache,
+// overdraw and vertex fetch. All functions work on indexed triangle lists and
+// are templated on the index type.
+//--------------------------------------------------------------------------------
+
+
+// Result of simulating a FIFO post-transform vertex cache over an index buffer
+struct VertexCacheStats {
+  int transformed;  // vertex shader invocations
+  double acmr;      // average cache miss ratio: transformed vertices per triangle, 0.5 at best
+  double atvr;      // average transform to vertex ratio: transformed per referenced vertex, 1 at best
+
+  VertexCacheStats() : transformed(0), acmr(0), atvr(0) {}
+};
+
+template<typename Idx>
+VertexCacheStats analyzeVertexCache(const Idx* idx, size_t numIndices, size_t numVertices, int cacheSize = 16) {
+  VertexCacheStats stats;
+  std::vector<unsigned> timestamp(numVertices, 0);  // when the vertex entered the cache
+  std::vector<char> used(numVertices, 0);
+  unsigned time = cacheSize + 1;
+  int referenced = 0;
+
+  for (size_t i = 0; i < numIndices; ++i) {
+    const Idx v = idx[i];
+    if (time - timestamp[v] > static_cast<unsigned>(cacheSize)) {
+      timestamp[v] = time++;
+      ++stats.transformed;
+    }
+    if (!used[v]) {
+      used[v] = 1;
+      ++referenced;
+    }
+  }
+  if (numIndices)
+    stats.acmr = stats.transformed / (numIndices / 3.0);
+  if (referenced)
+    stats.atvr = stats.transformed / static_cast<double>(referenced);
+  return stats;
+}
+
+namespace meshopt_detail {
+
+static const int FORSYTH_CACHE_SIZE = 32;
+
+// Forsyth's vertex score: recently used vertices score high, except for the
+// last three which were just used by the previous triangle, and vertices with
+// few triangles left get a boost so they are finished off
+inline float forsythScore(int cachePos, int remaining) {
+  if (remaining == 0)
+    return -1;
+  float score = 0;
+  if (cachePos >= 0) {
+    if (cachePos < 3) {
+      score = 0.75f;
+    }
+    else {
+      const float scaler = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+      score = std::pow(1.0f - (cachePos - 3) * scaler, 1.5f);
+    }
+  }
+  return score + 2.0f / std::sqrt(static_cast<float>(remaining));
+}
+
+} // namespace meshopt_detail
+
+// Reorders the triangles of idx for a post-transform vertex cache of unknown
+// size (Tom Forsyth, "Linear-Speed Vertex Cache Optimisation")
+template<typename Idx>
+void optimizeVertexCache(Idx* idx, size_t numIndices, size_t numVertices) {
+  using namespace meshopt_detail;
+  const int numTris = static_cast<int>(numIndices / 3);
+  if (numTris == 0)
+    return;
+
+  // triangles of every vertex
+  std::vector<int> offset(numVertices + 1, 0), remaining(numVertices, 0);
+  for (size_t i = 0; i < numIndices; ++i)
+    ++remaining[idx[i]];
+  for (size_t v = 0; v < numVertices; ++v)
+    offset[v + 1] = offset[v] + remaining[v];
+  std::vector<int> adjacency(numIndices), fill(offset.begin(), offset.end() - 1);
+  for (int t = 0; t < numTris; ++t)
+    for (int k = 0; k < 3; ++k)
+      adjacency[fill[idx[t * 3 + k]]++] = t;
+
+  std::vector<int> cachePos(numVertices, -1);
+  std::vector<float> vertexScore(numVertices), triScore(numTris);
+  for (size_t v = 0; v < numVertices; ++v)
+    vertexScore[v] = forsythScore(-1, remaining[v]);
+  for (int t = 0; t < numTris; ++t)
+    triScore[t] = vertexScore[idx[t * 3]] + vertexScore[idx[t * 3 + 1]] + vertexScore[idx[t * 3 + 2]];
+
+  std::vector<char> emitted(numTris, 0);
+  std::vector<Idx> out;
+  out.reserve(numIndices);
+  std::vector<int> cache, newCache;
+  cache.reserve(FORSYTH_CACHE_SIZE + 3);
+  newCache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+  int best = static_cast<int>(std::max_element(triScore.begin(), triScore.end()) - triScore.begin());
+  int cursor = 0;   // no triangle before it is left
+  while (best >= 0) {
+    emitted[best] = 1;
+    const Idx* tri = &idx[best * 3];
+    out.insert(out.end(), tri, tri + 3);
+
+    // the triangle's vertices go to the front of the LRU cache
+    newCache.assign(tri, tri + 3);
+    for (size_t i = 0; i < cache.size(); ++i)
+      if (cache[i] != newCache[0] && cache[i] != newCache[1] && cache[i] != newCache[2])
+        newCache.push_back(cache[i]);
+
+    for (int k = 0; k < 3; ++k) {
+      const int v = tri[k];
+      int* adj = &adjacency[offset[v]];
+      for (int i = 0; i < remaining[v]; ++i) {
+        if (adj[i] == best) {
+          adj[i] = adj[remaining[v] - 1];
+          break;
+        }
+      }
+      --remaining[v];
+    }
+
+    // rescore the cached vertices and the triangles using them
+    for (size_t i = 0; i < newCache.size(); ++i) {
+      const int v = newCache[i];
+      cachePos[v] = i < static_cast<size_t>(FORSYTH_CACHE_SIZE) ? static_cast<int>(i) : -1;
+      vertexScore[v] = forsythScore(cachePos[v], remaining[v]);
+    }
+    best = -1;
+    float bestScore = -1;
+    for (size_t i = 0; i < newCache.size(); ++i) {
+      const int v = newCache[i];
+      for (int j = 0; j < remaining[v]; ++j) {
+        const int t = adjacency[offset[v] + j];
+        const Idx* tv = &idx[t * 3];
+        triScore[t] = vertexScore[tv[0]] + vertexScore[tv[1]] + vertexScore[tv[2]];
+        if (triScore[t] > bestScore) {
+          bestScore = triScore[t];
+          best = t;
+        }
+      }
+    }
+    if (newCache.size() > static_cast<size_t>(FORSYTH_CACHE_SIZE))
+      newCache.resize(FORSYTH_CACHE_SIZE);
+    cache.swap(newCache);
+
+    // nothing left around the cache: continue with the next unused triangle
+    if (best < 0) {
+      while (cursor < numTris && emitted[cursor])
+        ++cursor;
+      best = cursor < numTris ? cursor : -1;
+    }
+  }
+  std::copy(out.begin(), out.end(), idx);
+}
+
+// Reorders clusters of triangles so that outward facing ones come first,
+// which lets early depth testing reject more of what is drawn behind them
+// (Sander et al., "Fast Triangle Reordering for Vertex Locality and Reduced
+// Overdraw"). Run after optimizeVertexCache: clusters are cut where the cache
+// is flushed anyway, and where the cluster's cache miss ratio stays within
+// threshold times that of its whole run, so the cache efficiency is kept.
+// position(v) returns the position of vertex v as a Cvec3.
+template<typename Idx, typename PositionFn>
+void optimizeOverdraw(Idx* idx, size_t numIndices, size_t numVertices, PositionFn position,
+                      double threshold = 1.05, int cacheSize = 16) {
+  const int numTris = static_cast<int>(numIndices / 3);
+  if (numTris < 2)
+    return;
+
+  // hard boundaries: triangles with three cache misses start a new run
+  std::vector<unsigned> timestamp(numVertices, 0);
+  unsigned time = cacheSize + 1;
+  std::vector<int> misses(numTris), hard;
+  for (int t = 0; t < numTris; ++t) {
+    misses[t] = 0;
+    for (int k = 0; k < 3; ++k) {
+      const Idx v = idx[t * 3 + k];
+      if (time - timestamp[v] > static_cast<unsigned>(cacheSize)) {
+        timestamp[v] = time++;
+        ++misses[t];
+      }
+    }
+    if (t == 0 || misses[t] == 3)
+      hard.push_back(t);
+  }
+  hard.push_back(numTris);
+
+  // soft boundaries inside each run, where the cluster so far, drawn with a
+  // cold cache, is about as cache efficient as the whole run
+  std::vector<int> clusters;
+  for (size_t h = 0; h + 1 < hard.size(); ++h) {
+    const int start = hard[h], end = hard[h + 1];
+    int total = 0;
+    for (int t = start; t < end; ++t)
+      total += misses[t];
+    const double runAcmr = total / static_cast<double>(end - start);
+
+    int clusterStart = start, clusterMisses = 0;
+    clusters.push_back(start);
+    time += cacheSize + 1;
+    for (int t = start; t < end; ++t) {
+      for (int k = 0; k < 3; ++k) {
+        const Idx v = idx[t * 3 + k];
+        if (time - timestamp[v] > static_cast<unsigned>(cacheSize)) {
+          timestamp[v] = time++;
+          ++clusterMisses;
+        }
+      }
+      if (t + 1 < end && clusterMisses / static_cast<double>(t + 1 - clusterStart) <= runAcmr * threshold) {
+        clusterStart = t + 1;
+        clusterMisses = 0;
+        clusters.push_back(clusterStart);
+        time += cacheSize + 1;
+      }
+    }
+  }
+  clusters.push_back(numTris);
+
+  // area weighted centroid and normal of every cluster, and of the mesh
+  const int numClusters = static_cast<int>(clusters.size()) - 1;
+  std::vector<Cvec3> centroid(numClusters), normal(numClusters);
+  Cvec3 meshCentroid;
+  double meshArea = 0;
+  for (int c = 0; c < numClusters; ++c) {
+    double area = 0;
+    for (int t = clusters[c]; t < clusters[c + 1]; ++t) {
+      const Cvec3 a = position(idx[t * 3]), b = position(idx[t * 3 + 1]), d = position(idx[t * 3 + 2]);
+      const Cvec3 n = cross(b - a, d - a);
+      const double triArea = norm(n);
+      centroid[c] += (a + b + d) * (triArea / 3);
+      normal[c] += n;
+      area += triArea;
+    }
+    meshCentroid += centroid[c];
+    meshArea += area;
+    if (area > 0)
+      centroid[c] /= area;
+    const double len = norm(normal[c]);
+    if (len > 0)
+      normal[c] /= len;
+  }
+  if (meshArea > 0)
+    meshCentroid /= meshArea;
+
+  std::vector<double> key(numClusters);
+  std::vector<int> order(numClusters);
+  for (int c = 0; c < numClusters; ++c) {
+    key[c] = dot(centroid[c] - meshCentroid, normal[c]);
+    order[c] = c;
+  }
+  std::stable_sort(order.begin(), order.end(), [&key](int a, int b) { return key[a] > key[b]; });
+
+  std::vector<Idx> out;
+  out.reserve(numIndices);
+  for (int i = 0; i < numClusters; ++i) {
+    const int c = order[i];
+    out.insert(out.end(), idx + clusters[c] * 3, idx + clusters[c + 1] * 3);
+  }
+  std::copy(out.begin(), out.end(), idx);
+}
+
+// Reorders vtx in the order the index buffer first references its vertices,
+// so vertex fetch walks memory linearly, and remaps idx. Unreferenced
+// vertices are dropped. Returns the new number of vertices.
+template<typename Vertex, typename Idx>
+size_t optimizeVertexFetch(std::vector<Vertex>& vtx, Idx* idx, size_t numIndices) {
+  std::vector<int> remap(vtx.size(), -1);
+  std::vector<Vertex> out;
+  out.reserve(vtx.size());
+  for (size_t i = 0; i < numIndices; ++i) {
+    int& r = remap[idx[i]];
+    if (r < 0) {
+      r = static_cast<int>(out.size());
+      out.push_back(vtx[idx[i]]);
+    }
+    idx[i] = static_cast<Idx>(r);
+  }
+  vtx.swap(out);
+  return vtx.size();
+}
+
+#endif
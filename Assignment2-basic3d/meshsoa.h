@@ -0,0 +1,265 @@
+#ifndef MESHSOA_H
+#define MESHSOA_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <new>
+#include <vector>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE__)
+#define MESHSOA_SSE 1
+#include <xmmintrin.h>
+#endif
+
+#include "cvec.h"
+#include "matrix4.h"
+#include "bounds.h"
+#include "geometrymaker.h"
+
+//--------------------------------------------------------------------------------
+// Structure-of-arrays vertex streams for CPU-side mesh processing
+//--------------------------------------------------------------------------------
+
+
+// Allocator returning memory aligned to Align bytes, so the streams below can
+// be read with aligned SIMD loads
+template<typename T, size_t Align>
+struct AlignedAllocator {
+  typedef T value_type;
+
+  template<typename U>
+  struct rebind {
+    typedef AlignedAllocator<U, Align> other;
+  };
+
+  AlignedAllocator() {}
+
+  template<typename U>
+  AlignedAllocator(const AlignedAllocator<U, Align>&) {}
+
+  // over-allocates and keeps the pointer to free just before the aligned block
+  T* allocate(size_t n) {
+    char* raw = static_cast<char*>(::operator new(n * sizeof(T) + Align + sizeof(void*)));
+    const size_t aligned = (reinterpret_cast<size_t>(raw) + sizeof(void*) + Align - 1) & ~(Align - 1);
+    reinterpret_cast<void**>(aligned)[-1] = raw;
+    return reinterpret_cast<T*>(aligned);
+  }
+
+  void deallocate(T* p, size_t) {
+    ::operator delete(reinterpret_cast<void**>(p)[-1]);
+  }
+
+  template<typename U>
+  bool operator == (const AlignedAllocator<U, Align>&) const {
+    return true;
+  }
+
+  template<typename U>
+  bool operator != (const AlignedAllocator<U, Align>&) const {
+    return false;
+  }
+};
+
+// Vertex positions, normals and texture coordinates with one 16 byte aligned
+// float array per component. Passes over whole meshes (bounds, transforms,
+// normal recomputation) run four vertices at a time with SSE, and the result
+// is interleaved into any vertex layout through a VertexSpan at upload time.
+class MeshSoA {
+public:
+  typedef std::vector<float, AlignedAllocator<float, 16> > Stream;
+
+  Stream px, py, pz;
+  Stream nx, ny, nz;
+  Stream u, v;
+
+  size_t size() const {
+    return px.size();
+  }
+
+  void resize(size_t n) {
+    Stream* streams[] = { &px, &py, &pz, &nx, &ny, &nz, &u, &v };
+    for (int i = 0; i < 8; ++i)
+      streams[i]->resize(n);
+  }
+
+  // Copies n vertices in from the attributes of in (NULL ones are skipped)
+  void gather(const VertexSpan& in, size_t n) {
+    resize(n);
+    for (size_t i = 0; i < n; ++i) {
+      if (in.pos) {
+        const float* p = in.pos + i * in.posStride;
+        px[i] = p[0], py[i] = p[1], pz[i] = p[2];
+      }
+      if (in.normal) {
+        const float* q = in.normal + i * in.normalStride;
+        nx[i] = q[0], ny[i] = q[1], nz[i] = q[2];
+      }
+      if (in.tex) {
+        const float* t = in.tex + i * in.texStride;
+        u[i] = t[0], v[i] = t[1];
+      }
+    }
+  }
+
+  // Writes the vertices out to the attributes of out, e.g., straight into a
+  // mapped vertex buffer
+  void interleave(const VertexSpan& out) const {
+    for (size_t i = 0; i < size(); ++i) {
+      if (out.pos) {
+        float* p = out.pos + i * out.posStride;
+        p[0] = px[i], p[1] = py[i], p[2] = pz[i];
+      }
+      if (out.normal) {
+        float* q = out.normal + i * out.normalStride;
+        q[0] = nx[i], q[1] = ny[i], q[2] = nz[i];
+      }
+      if (out.tex) {
+        float* t = out.tex + i * out.texStride;
+        t[0] = u[i], t[1] = v[i];
+      }
+    }
+  }
+
+  Aabb bounds() const {
+    return transformedBounds(Matrix4());
+  }
+
+  // Returns the exact box of the positions transformed by the affine m, tighter
+  // than transforming the box of the mesh
+  Aabb transformedBounds(const Matrix4& m) const {
+    Aabb box;
+    const size_t n = size();
+    if (n == 0)
+      return box;
+    float lo[3], hi[3];
+    for (int k = 0; k < 3; ++k) {
+      lo[k] = hi[k] = static_cast<float>(m(k,0) * px[0] + m(k,1) * py[0] + m(k,2) * pz[0] + m(k,3));
+    }
+
+    size_t i = 0;
+#ifdef MESHSOA_SSE
+    __m128 vlo[3], vhi[3], r[3][4];
+    for (int k = 0; k < 3; ++k) {
+      vlo[k] = _mm_set1_ps(lo[k]);
+      vhi[k] = _mm_set1_ps(hi[k]);
+      for (int j = 0; j < 4; ++j)
+        r[k][j] = _mm_set1_ps(static_cast<float>(m(k,j)));
+    }
+    for (; i + 4 <= n; i += 4) {
+      const __m128 x = _mm_load_ps(&px[i]), y = _mm_load_ps(&py[i]), z = _mm_load_ps(&pz[i]);
+      for (int k = 0; k < 3; ++k) {
+        const __m128 t = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r[k][0], x), _mm_mul_ps(r[k][1], y)),
+                                    _mm_add_ps(_mm_mul_ps(r[k][2], z), r[k][3]));
+        vlo[k] = _mm_min_ps(vlo[k], t);
+        vhi[k] = _mm_max_ps(vhi[k], t);
+      }
+    }
+    for (int k = 0; k < 3; ++k) {
+      float l[4], h[4];
+      _mm_storeu_ps(l, vlo[k]);
+      _mm_storeu_ps(h, vhi[k]);
+      for (int j = 0; j < 4; ++j) {
+        lo[k] = std::min(lo[k], l[j]);
+        hi[k] = std::max(hi[k], h[j]);
+      }
+    }
+#endif
+    for (; i < n; ++i) {
+      for (int k = 0; k < 3; ++k) {
+        const float t = static_cast<float>(m(k,0) * px[i] + m(k,1) * py[i] + m(k,2) * pz[i] + m(k,3));
+        lo[k] = std::min(lo[k], t);
+        hi[k] = std::max(hi[k], t);
+      }
+    }
+    return Aabb(Cvec3(lo[0], lo[1], lo[2]), Cvec3(hi[0], hi[1], hi[2]));
+  }
+
+  // Writes into out the mesh transformed by the affine m: positions by m,
+  // normals by its normal matrix, renormalized
+  void transform(const Matrix4& m, MeshSoA& out) const {
+    const size_t n = size();
+    out.resize(n);
+    if (n == 0)
+      return;
+    out.u = u;
+    out.v = v;
+    transform3(m, true, &px[0], &py[0], &pz[0], &out.px[0], &out.py[0], &out.pz[0], n);
+    transform3(normalMatrix(m), false, &nx[0], &ny[0], &nz[0], &out.nx[0], &out.ny[0], &out.nz[0], n);
+    out.normalizeNormals();
+  }
+
+  // Recomputes the normals as the area weighted average of the normals of the
+  // triangles around every vertex
+  template<typename Idx>
+  void recomputeNormals(const Idx* idx, size_t numIndices) {
+    const size_t n = size();
+    std::fill(nx.begin(), nx.end(), 0.0f);
+    std::fill(ny.begin(), ny.end(), 0.0f);
+    std::fill(nz.begin(), nz.end(), 0.0f);
+    for (size_t t = 0; t + 2 < numIndices; t += 3) {
+      const Idx a = idx[t], b = idx[t + 1], c = idx[t + 2];
+      const float e1x = px[b] - px[a], e1y = py[b] - py[a], e1z = pz[b] - pz[a];
+      const float e2x = px[c] - px[a], e2y = py[c] - py[a], e2z = pz[c] - pz[a];
+      const float fx = e1y * e2z - e1z * e2y, fy = e1z * e2x - e1x * e2z, fz = e1x * e2y - e1y * e2x;
+      const Idx tri[3] = { a, b, c };
+      for (int k = 0; k < 3; ++k) {
+        nx[tri[k]] += fx;
+        ny[tri[k]] += fy;
+        nz[tri[k]] += fz;
+      }
+    }
+    if (n)
+      normalizeNormals();
+  }
+
+  void normalizeNormals() {
+    const size_t n = size();
+    size_t i = 0;
+#ifdef MESHSOA_SSE
+    const __m128 tiny = _mm_set1_ps(1e-20f);
+    for (; i + 4 <= n; i += 4) {
+      const __m128 x = _mm_load_ps(&nx[i]), y = _mm_load_ps(&ny[i]), z = _mm_load_ps(&nz[i]);
+      const __m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+      const __m128 s = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(_mm_max_ps(len2, tiny)));
+      _mm_store_ps(&nx[i], _mm_mul_ps(x, s));
+      _mm_store_ps(&ny[i], _mm_mul_ps(y, s));
+      _mm_store_ps(&nz[i], _mm_mul_ps(z, s));
+    }
+#endif
+    for (; i < n; ++i) {
+      const float s = 1.0f / std::sqrt(std::max(nx[i] * nx[i] + ny[i] * ny[i] + nz[i] * nz[i], 1e-20f));
+      nx[i] *= s;
+      ny[i] *= s;
+      nz[i] *= s;
+    }
+  }
+
+private:
+  // o = m * (x, y, z, w) for n vectors, w being 1 for points and 0 for directions
+  static void transform3(const Matrix4& m, bool point, const float* x, const float* y, const float* z,
+                         float* ox, float* oy, float* oz, size_t n) {
+    float r[3][4];
+    for (int k = 0; k < 3; ++k)
+      for (int j = 0; j < 4; ++j)
+        r[k][j] = j == 3 && !point ? 0.0f : static_cast<float>(m(k,j));
+    float* o[3] = { ox, oy, oz };
+
+    size_t i = 0;
+#ifdef MESHSOA_SSE
+    for (; i + 4 <= n; i += 4) {
+      const __m128 vx = _mm_load_ps(x + i), vy = _mm_load_ps(y + i), vz = _mm_load_ps(z + i);
+      for (int k = 0; k < 3; ++k) {
+        const __m128 t = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(r[k][0]), vx), _mm_mul_ps(_mm_set1_ps(r[k][1]), vy)),
+                                    _mm_add_ps(_mm_mul_ps(_mm_set1_ps(r[k][2]), vz), _mm_set1_ps(r[k][3])));
+        _mm_store_ps(o[k] + i, t);
+      }
+    }
+#endif
+    for (; i < n; ++i)
+      for (int k = 0; k < 3; ++k)
+        o[k][i] = r[k][0] * x[i] + r[k][1] * y[i] + r[k][2] * z[i] + r[k][3];
+  }
+};
+
+#endif
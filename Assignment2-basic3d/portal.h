@@ -0,0 +1,263 @@
+#ifndef PORTAL_H
+#define PORTAL_H
+
+#include <vector>
+
+#include "cvec.h"
+#include "bounds.h"
+
+//--------------------------------------------------------------------------------
+// Cell and portal visibility for indoor levels
+//--------------------------------------------------------------------------------
+
+
+// Counters of one portal traversal
+struct PortalStats {
+  int cellsVisited;   // cells reached from the eye's cell
+  int portalsTested;  // portals clipped against a frustum
+  int portalsPassed;  // portals the view went through
+  int objectsTested;  // object and hierarchy boxes tested against a frustum
+
+  PortalStats() : cellsVisited(0), portalsTested(0), portalsPassed(0), objectsTested(0) {}
+};
+
+// A level split into convex cells connected by convex openings (portals).
+// Starting from the cell holding the eye, the view frustum is clipped to each
+// portal it sees and narrowed to the planes through the eye and the clipped
+// portal edges. Only the cells reached this way, and only their objects
+// inside the narrowed frustum, are visible.
+class CellPortalGraph {
+  struct Cell {
+    Aabb bounds;                  // where the eye can be; empty for cells only reached through portals
+    std::vector<int> objects;
+    std::vector<int> portals;
+    const Bvh* bvh;               // more objects, culled through a hierarchy; may be null
+
+    Cell() : bvh(NULL) {}
+  };
+
+  struct Portal {
+    int cells[2];
+    std::vector<Cvec3> corners;   // convex polygon, in order
+    Cvec3 center, normal;
+  };
+
+  std::vector<Cell> cells_;
+  std::vector<Portal> portals_;
+  std::vector<Aabb> boxes_;       // world box of every object
+  std::vector<int> mark_;         // traversal stamp per object, to report each once
+  std::vector<char> onPath_;      // cells on the current traversal path
+  std::vector<int> bvhVisible_;   // scratch for the objects a cell's hierarchy reports
+  int stamp_;
+
+  // A clipped portal gives one plane per corner plus its own plane. Beyond
+  // that many corners the current frustum is kept, which is conservative.
+  static const int MAX_CLIPPED_CORNERS = Frustum::MAX_PLANES - 1;
+
+  // Sutherland-Hodgman clipping of a convex polygon against one plane
+  static void clip(const std::vector<Cvec3>& in, const Cvec4& plane, std::vector<Cvec3>& out) {
+    out.clear();
+    for (size_t i = 0; i < in.size(); ++i) {
+      const Cvec3& a = in[i];
+      const Cvec3& b = in[(i + 1) % in.size()];
+      const double da = Frustum::distance(plane, a), db = Frustum::distance(plane, b);
+      if (da >= 0)
+        out.push_back(a);
+      if ((da >= 0) != (db >= 0))
+        out.push_back(a + (b - a) * (da / (da - db)));
+    }
+  }
+
+  void visit(int cell, const Cvec3& eye, const Frustum& frustum, std::vector<int>& visible, PortalStats& stats) {
+    const Cell& c = cells_[cell];
+    onPath_[cell] = 1;
+    ++stats.cellsVisited;
+
+    for (size_t i = 0; i < c.objects.size(); ++i) {
+      const int o = c.objects[i];
+      if (mark_[o] == stamp_)
+        continue;
+      ++stats.objectsTested;
+      if (frustum.classify(boxes_[o]) != CULL_OUTSIDE) {
+        mark_[o] = stamp_;
+        visible.push_back(o);
+      }
+    }
+    if (c.bvh) {
+      CullStats cullStats;
+      bvhVisible_.clear();
+      c.bvh->cull(frustum, bvhVisible_, cullStats);
+      stats.objectsTested += cullStats.tested;
+      for (size_t i = 0; i < bvhVisible_.size(); ++i) {
+        const int o = bvhVisible_[i];
+        if (mark_[o] != stamp_) {
+          mark_[o] = stamp_;
+          visible.push_back(o);
+        }
+      }
+    }
+
+    for (size_t i = 0; i < c.portals.size(); ++i) {
+      const Portal& p = portals_[c.portals[i]];
+      const int next = p.cells[0] == cell ? p.cells[1] : p.cells[0];
+      if (onPath_[next])
+        continue;
+
+      ++stats.portalsTested;
+      Frustum narrowed;
+      if (!narrow(p, eye, frustum, narrowed))
+        continue;
+      ++stats.portalsPassed;
+      visit(next, eye, narrowed, visible, stats);
+    }
+    onPath_[cell] = 0;
+  }
+
+  // Builds in narrowed the part of frustum seen through portal p. Returns
+  // false when the portal is not visible at all.
+  static bool narrow(const Portal& p, const Cvec3& eye, const Frustum& frustum, Frustum& narrowed) {
+    // from (almost) inside the portal plane, the portal covers the whole view
+    double side = dot(eye - p.center, p.normal);
+    if (std::abs(side) < 1e-3) {
+      narrowed = frustum;
+      return true;
+    }
+
+    std::vector<Cvec3> poly(p.corners), tmp;
+    for (int i = 0; i < frustum.numPlanes && !poly.empty(); ++i) {
+      clip(poly, frustum.planes[i], tmp);
+      poly.swap(tmp);
+    }
+    if (poly.size() < 3)
+      return false;
+    if (static_cast<int>(poly.size()) > MAX_CLIPPED_CORNERS) {
+      narrowed = frustum;
+      return true;
+    }
+
+    Cvec3 centroid;
+    for (size_t i = 0; i < poly.size(); ++i) {
+      centroid += poly[i];
+    }
+    centroid /= static_cast<double>(poly.size());
+
+    // one plane through the eye and each edge, facing the polygon
+    narrowed = Frustum();
+    for (size_t i = 0; i < poly.size(); ++i) {
+      const Cvec3& a = poly[i];
+      const Cvec3& b = poly[(i + 1) % poly.size()];
+      Cvec3 n = cross(a - eye, b - eye);
+      const double len = norm(n);
+      if (len < CS175_EPS)
+        continue;
+      n /= len;
+      if (dot(n, centroid - eye) < 0)
+        n = -n;
+      narrowed.addPlane(Cvec4(n[0], n[1], n[2], -dot(n, eye)));
+    }
+
+    // and the portal itself, so nothing between the eye and the portal is seen through it
+    const Cvec3 away = side < 0 ? p.normal : -p.normal;
+    narrowed.addPlane(Cvec4(away[0], away[1], away[2], -dot(away, p.center)));
+    return true;
+  }
+
+public:
+  CellPortalGraph() : stamp_(0) {}
+
+  // Adds a cell. Cells with empty bounds can only be seen through portals.
+  int addCell(const Aabb& bounds) {
+    Cell c;
+    c.bounds = bounds;
+    cells_.push_back(c);
+    onPath_.push_back(0);
+    return static_cast<int>(cells_.size()) - 1;
+  }
+
+  // Puts an object into a cell. An object may belong to several cells (e.g.,
+  // a wall seen from both of its sides).
+  void addObject(int cell, int object, const Aabb& box) {
+    if (object >= static_cast<int>(boxes_.size())) {
+      boxes_.resize(object + 1);
+      mark_.resize(object + 1, 0);
+    }
+    boxes_[object] = box;
+    cells_[cell].objects.push_back(object);
+  }
+
+  // Gives a cell a hierarchy of further objects, for cells holding too many to
+  // test one by one. The hierarchy must outlive the graph.
+  void setObjects(int cell, const Bvh* bvh) {
+    if (bvh->numObjects() > static_cast<int>(mark_.size()))
+      mark_.resize(bvh->numObjects(), 0);
+    cells_[cell].bvh = bvh;
+  }
+
+  // Connects two cells through a convex polygon given by its corners in order
+  int addPortal(int cellA, int cellB, const std::vector<Cvec3>& corners) {
+    assert(corners.size() >= 3);
+    Portal p;
+    p.cells[0] = cellA;
+    p.cells[1] = cellB;
+    p.corners = corners;
+    for (size_t i = 0; i < corners.size(); ++i) {
+      p.center += corners[i];
+    }
+    p.center /= static_cast<double>(corners.size());
+    p.normal = normalize(cross(corners[1] - corners[0], corners[2] - corners[0]));
+
+    const int id = static_cast<int>(portals_.size());
+    portals_.push_back(p);
+    cells_[cellA].portals.push_back(id);
+    cells_[cellB].portals.push_back(id);
+    return id;
+  }
+
+  // Connects two cells through an axis aligned rectangle, given as a box that
+  // is flat along one axis
+  int addPortal(int cellA, int cellB, const Aabb& rect) {
+    const Cvec3 ext = rect.hi - rect.lo;
+    const int flat = ext[0] < ext[1] ? (ext[0] < ext[2] ? 0 : 2) : (ext[1] < ext[2] ? 1 : 2);
+    const int u = (flat + 1) % 3, v = (flat + 2) % 3;
+    std::vector<Cvec3> corners(4, rect.lo);
+    corners[1][u] = rect.hi[u];
+    corners[2][u] = rect.hi[u];
+    corners[2][v] = rect.hi[v];
+    corners[3][v] = rect.hi[v];
+    return addPortal(cellA, cellB, corners);
+  }
+
+  // Returns the cell containing p, or -1
+  int findCell(const Cvec3& p) const {
+    for (size_t i = 0; i < cells_.size(); ++i) {
+      const Aabb& b = cells_[i].bounds;
+      if (!b.isEmpty() &&
+          p[0] >= b.lo[0] && p[0] <= b.hi[0] &&
+          p[1] >= b.lo[1] && p[1] <= b.hi[1] &&
+          p[2] >= b.lo[2] && p[2] <= b.hi[2])
+        return static_cast<int>(i);
+    }
+    return -1;
+  }
+
+  // Appends to visible every object seen from eye within frustum, each once.
+  // Returns false, appending nothing, when the eye is in no cell.
+  bool traverse(const Cvec3& eye, const Frustum& frustum, std::vector<int>& visible, PortalStats& stats) {
+    const int start = findCell(eye);
+    if (start < 0)
+      return false;
+    ++stamp_;
+    visit(start, eye, frustum, visible, stats);
+    return true;
+  }
+
+  const Aabb& bounds(int cell) const {
+    return cells_[cell].bounds;
+  }
+
+  int numCells() const {
+    return static_cast<int>(cells_.size());
+  }
+};
+
+#endif
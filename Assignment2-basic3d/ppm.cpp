@@ -15,6 +15,7 @@
 #endif
 
 #include "ppm.h"
+#include "profiler.h"
 
 using namespace std;
 
@@ -76,6 +77,7 @@ static void ppmReadHeader(istream& is, int &width, int &height) {
 
 //Reads the actual PPM data and stores returns in in a pixels.
 void ppmRead(const char *filename, int& width, int& height, std::vector<PackedPixel>& pixels) {
+  PROFILE_SCOPE("ppmRead");
   ifstream is(filename, ios::binary);
   if (!is.is_open())
     throw runtime_error(string("ppmRead: Cannot open file ") + filename + " for read");
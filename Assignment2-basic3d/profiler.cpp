@@ -0,0 +1,142 @@
+#include "profiler.h"
+
+#ifdef ENABLE_PROFILER
+
+#include <algorithm>
+#include <cstdio>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+thread_local ProfileRing* t_profileRing = NULL;
+
+namespace {
+
+typedef chrono::steady_clock Clock;
+
+// Every ring ever created, kept past the end of its thread for the export
+struct Registry {
+  mutex lock;
+  vector<unique_ptr<ProfileRing> > rings;
+
+  // a tick count and clock time read together, to convert ticks to seconds
+  unsigned long long originTicks;
+  Clock::time_point originTime;
+
+  Registry() : originTicks(profileTicks()), originTime(Clock::now()) {}
+};
+
+Registry& registry() {
+  static Registry r;
+  return r;
+}
+
+// Microseconds per tick, measured against the steady clock since the origin
+double microsecondsPerTick() {
+  Registry& r = registry();
+  if (Clock::now() - r.originTime < chrono::milliseconds(20))
+    this_thread::sleep_for(chrono::milliseconds(20));
+  const unsigned long long ticks = profileTicks() - r.originTicks;
+  return chrono::duration<double, micro>(Clock::now() - r.originTime).count() / max(ticks, 1ull);
+}
+
+// Calls fn(ring, event) for the events still held by every ring
+template<typename Fn>
+void forEachEvent(Fn fn) {
+  Registry& r = registry();
+  lock_guard<mutex> guard(r.lock);
+  for (size_t i = 0; i < r.rings.size(); ++i) {
+    const ProfileRing& ring = *r.rings[i];
+    const unsigned long long n = min<unsigned long long>(ring.count, PROFILE_RING_EVENTS);
+    for (unsigned long long k = ring.count - n; k < ring.count; ++k)
+      fn(ring, ring.events[k & (PROFILE_RING_EVENTS - 1)]);
+  }
+}
+
+}
+
+ProfileRing* profileRegisterTrack(const char* track) {
+  Registry& r = registry();
+  lock_guard<mutex> guard(r.lock);
+  unique_ptr<ProfileRing> ring(new ProfileRing);
+  ring->count = 0;
+  ring->thread = static_cast<int>(r.rings.size());
+  ring->track = track;
+  r.rings.push_back(move(ring));
+  return r.rings.back().get();
+}
+
+ProfileRing* profileRegisterThread() {
+  t_profileRing = profileRegisterTrack(NULL);
+  return t_profileRing;
+}
+
+double profileTicksPerSecond() {
+  Registry& r = registry();
+  const double seconds = chrono::duration<double>(Clock::now() - r.originTime).count();
+  return seconds > 0 ? (profileTicks() - r.originTicks) / seconds : 1e9;
+}
+
+void profilerWriteChromeTrace(const char* filename) {
+  FILE* f = fopen(filename, "w");
+  if (!f)
+    throw runtime_error(string("Cannot write ") + filename);
+
+  const double scale = microsecondsPerTick();
+  const unsigned long long origin = registry().originTicks;
+  bool first = true;
+  fputs("{\"traceEvents\":[\n", f);
+  {
+    Registry& r = registry();
+    lock_guard<mutex> guard(r.lock);
+    for (size_t i = 0; i < r.rings.size(); ++i) {
+      if (!r.rings[i]->track)
+        continue;
+      fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+              first ? "" : ",\n", r.rings[i]->thread, r.rings[i]->track);
+      first = false;
+    }
+  }
+  forEachEvent([&](const ProfileRing& ring, const ProfileEvent& e) {
+    fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+            first ? "" : ",\n", e.name, ring.thread,
+            static_cast<double>(static_cast<long long>(e.start - origin)) * scale, static_cast<double>(e.end - e.start) * scale);
+    first = false;
+  });
+  fputs("\n],\"displayTimeUnit\":\"ms\"}\n", f);
+  if (fclose(f) != 0)
+    throw runtime_error(string("Cannot write ") + filename);
+}
+
+void profilerPrintSummary(ostream& os) {
+  const double msPerTick = microsecondsPerTick() / 1000;
+  map<string, vector<double> > durations;
+  forEachEvent([&](const ProfileRing& ring, const ProfileEvent& e) {
+    durations[ring.track ? string(ring.track) + " " + e.name : string(e.name)].push_back(static_cast<double>(e.end - e.start) * msPerTick);
+  });
+
+  os << left << setw(28) << "scope" << right << setw(10) << "count" << setw(12) << "mean ms"
+     << setw(12) << "p50 ms" << setw(12) << "p99 ms" << '\n';
+  for (map<string, vector<double> >::iterator i = durations.begin(); i != durations.end(); ++i) {
+    vector<double>& d = i->second;
+    sort(d.begin(), d.end());
+    double sum = 0;
+    for (size_t k = 0; k < d.size(); ++k)
+      sum += d[k];
+    os << left << setw(28) << i->first << right << setw(10) << d.size() << fixed << setprecision(4)
+       << setw(12) << sum / d.size() << setw(12) << d[d.size() / 2]
+       << setw(12) << d[min(d.size() - 1, d.size() * 99 / 100)] << '\n';
+    os.unsetf(ios::fixed);
+  }
+  os.flush();
+}
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+//--------------------------------------------------------------------------------
+// Scoped CPU timers, exported as a Chrome trace and summarized on exit
+//--------------------------------------------------------------------------------
+
+// Define ENABLE_PROFILER for the whole build to turn the timers on; the
+// Profile|x64 configuration of Assignment2-basic3d.vcxproj is Release with it
+// defined. Without it PROFILE_SCOPE expands to nothing and profiler.cpp
+// compiles to nothing.
+//
+//   void drawStuff() {
+//     PROFILE_SCOPE("drawStuff");
+//     ...
+//   }
+//
+// A scope reads the time stamp counter on entry and exit and writes one event
+// into a ring owned by its thread, so it takes no lock and allocates nothing.
+// A ring keeps the last PROFILE_RING_EVENTS events of its thread. The rings
+// are only read by the export functions, which must run once the profiled
+// threads are idle, e.g., on exit.
+
+#ifdef ENABLE_PROFILER
+
+#include <chrono>
+#include <iosfwd>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+static const unsigned PROFILE_RING_EVENTS = 1 << 16;   // a power of two
+
+struct ProfileEvent {
+  const char* name;                 // a string literal, compared by address
+  unsigned long long start, end;    // profileTicks()
+};
+
+struct ProfileRing {
+  ProfileEvent events[PROFILE_RING_EVENTS];
+  unsigned long long count;         // events ever recorded, the last ones are kept
+  int thread;                       // small id in the order the rings were created
+  const char* track;                // name of a ring that is not a thread's, else NULL
+};
+
+// The time stamp counter where there is one, else the steady clock
+inline unsigned long long profileTicks() {
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+extern thread_local ProfileRing* t_profileRing;
+
+// The ring of the calling thread, created on its first event
+ProfileRing* profileRegisterThread();
+
+// A ring of its own for events timed elsewhere than on a CPU thread, e.g.,
+// on the GPU, exported as a track named track. One thread records into it.
+ProfileRing* profileRegisterTrack(const char* track);
+
+// Ticks per second, measured against the steady clock since the profiler
+// started, so it sharpens as the program runs
+double profileTicksPerSecond();
+
+inline void profileRecordTo(ProfileRing* ring, const char* name, unsigned long long start, unsigned long long end) {
+  ProfileEvent& e = ring->events[ring->count++ & (PROFILE_RING_EVENTS - 1)];
+  e.name = name;
+  e.start = start;
+  e.end = end;
+}
+
+inline void profileRecord(const char* name, unsigned long long start, unsigned long long end) {
+  ProfileRing* ring = t_profileRing;
+  if (!ring)
+    ring = profileRegisterThread();
+  profileRecordTo(ring, name, start, end);
+}
+
+class ProfileScope {
+  const char* name_;
+  unsigned long long start_;
+
+public:
+  explicit ProfileScope(const char* name) : name_(name), start_(profileTicks()) {}
+
+  ~ProfileScope() {
+    profileRecord(name_, start_, profileTicks());
+  }
+};
+
+// Writes the events of all threads in the Chrome trace event format, for
+// chrome://tracing or ui.perfetto.dev. Throws runtime_error.
+void profilerWriteChromeTrace(const char* filename);
+
+// Prints the count, mean, p50 and p99 milliseconds of every scope name, the
+// names of tracks prefixed with the track
+void profilerPrintSummary(std::ostream& os);
+
+#define PROFILE_CONCAT2(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT2(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+
+#else
+
+#define PROFILE_SCOPE(name) ((void)0)
+
+#endif
+
+#endif
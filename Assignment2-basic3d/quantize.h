@@ -0,0 +1,129 @@
+#ifndef QUANTIZE_H
+#define QUANTIZE_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "cvec.h"
+
+//--------------------------------------------------------------------------------
+// Packing of vertex attributes into the compact formats GL can fetch directly:
+// normalized 16 bit integers, GL_INT_2_10_10_10_REV and half floats, and the
+// unpacking GL does, for drivers that cannot fetch them
+//--------------------------------------------------------------------------------
+
+
+// Maps [-1, 1] to a GL_SHORT read back as normalized, rounding to nearest
+inline short packSnorm16(float v) {
+  v = std::max(-1.0f, std::min(v, 1.0f));
+  return static_cast<short>(std::floor(v * 32767.0f + 0.5f));
+}
+
+// As GL reads a normalized GL_SHORT
+inline float unpackSnorm16(short v) {
+  return std::max(v / 32767.0f, -1.0f);
+}
+
+// Packs a unit vector into GL_INT_2_10_10_10_REV: x in the low 10 bits, then y
+// and z, each a signed normalized 10 bit value. w is left 0.
+inline unsigned packSnorm1010102(const Cvec3f& v) {
+  unsigned packed = 0;
+  for (int i = 0; i < 3; ++i) {
+    const float c = std::max(-1.0f, std::min(v[i], 1.0f));
+    const int q = static_cast<int>(std::floor(c * 511.0f + 0.5f));
+    packed |= (static_cast<unsigned>(q) & 0x3ff) << (10 * i);
+  }
+  return packed;
+}
+
+// As GL reads a normalized GL_INT_2_10_10_10_REV, without w
+inline Cvec3f unpackSnorm1010102(unsigned packed) {
+  Cvec3f v;
+  for (int i = 0; i < 3; ++i) {
+    int q = static_cast<int>((packed >> (10 * i)) & 0x3ff);
+    if (q & 0x200)
+      q -= 0x400;
+    v[i] = std::max(q / 511.0f, -1.0f);
+  }
+  return v;
+}
+
+// IEEE 754 binary16 from binary32, rounding to nearest. Values too small for a
+// half become (signed) zero, values too large become infinity.
+inline unsigned short packHalf(float f) {
+  unsigned bits;
+  std::memcpy(&bits, &f, sizeof(bits));
+  const unsigned sign = (bits >> 16) & 0x8000;
+  const int exponent = static_cast<int>((bits >> 23) & 0xff) - 127 + 15;
+  unsigned mantissa = bits & 0x7fffff;
+
+  if (exponent >= 31)
+    return static_cast<unsigned short>(sign | 0x7c00 | ((bits & 0x7f800000) == 0x7f800000 && mantissa ? 0x200 : 0));
+  if (exponent <= 0) {
+    if (exponent < -10)
+      return static_cast<unsigned short>(sign);
+    // subnormal half
+    mantissa |= 0x800000;
+    const int shift = 14 - exponent;
+    unsigned half = mantissa >> shift;
+    if ((mantissa >> (shift - 1)) & 1)
+      ++half;
+    return static_cast<unsigned short>(sign | half);
+  }
+
+  unsigned half = sign | (exponent << 10) | (mantissa >> 13);
+  if (mantissa & 0x1000)
+    ++half;   // may carry into the exponent, which is still the right rounding
+  return static_cast<unsigned short>(half);
+}
+
+// IEEE 754 binary32 from binary16, exact
+inline float unpackHalf(unsigned short h) {
+  const unsigned sign = static_cast<unsigned>(h & 0x8000) << 16;
+  const int exponent = (h >> 10) & 0x1f;
+  const unsigned mantissa = h & 0x3ff;
+  float f;
+  if (exponent == 0) {
+    f = std::ldexp(static_cast<float>(mantissa), -24);   // zero or subnormal
+    return sign ? -f : f;
+  }
+  unsigned bits;
+  if (exponent == 31)
+    bits = sign | 0x7f800000 | (mantissa << 13);
+  else
+    bits = sign | static_cast<unsigned>(exponent - 15 + 127) << 23 | (mantissa << 13);
+  std::memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+// Dequantisation of positions packed as normalized 16 bit integers relative to
+// a box: p = packed * scale + bias. Degenerate axes of the box get a scale of
+// 1 so that packing does not divide by zero.
+struct PositionQuantization {
+  Cvec3f scale, bias;
+
+  PositionQuantization() : scale(1, 1, 1) {}
+
+  PositionQuantization(const Cvec3& lo, const Cvec3& hi) {
+    for (int i = 0; i < 3; ++i) {
+      bias[i] = static_cast<float>((lo[i] + hi[i]) * 0.5);
+      const float half = static_cast<float>((hi[i] - lo[i]) * 0.5);
+      scale[i] = half > 0 ? half : 1.0f;
+    }
+  }
+
+  void pack(const Cvec3f& p, short out[3]) const {
+    for (int i = 0; i < 3; ++i)
+      out[i] = packSnorm16((p[i] - bias[i]) / scale[i]);
+  }
+
+  Cvec3f unpack(const short p[3]) const {
+    Cvec3f out;
+    for (int i = 0; i < 3; ++i)
+      out[i] = unpackSnorm16(p[i]) * scale[i] + bias[i];
+    return out;
+  }
+};
+
+#endif
@@ -0,0 +1,265 @@
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "scenefile.h"
+
+using namespace std;
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const char* filename) : data_(NULL), size_(0), file_(INVALID_HANDLE_VALUE), mapping_(NULL) {
+  file_ = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (file_ == INVALID_HANDLE_VALUE)
+    throw runtime_error(string("Cannot open ") + filename);
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file_, &size) || size.QuadPart == 0) {
+    CloseHandle(file_);
+    throw runtime_error(string("Cannot map empty file ") + filename);
+  }
+  size_ = static_cast<size_t>(size.QuadPart);
+
+  mapping_ = CreateFileMappingA(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (mapping_)
+    data_ = static_cast<const unsigned char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+  if (!data_) {
+    if (mapping_)
+      CloseHandle(mapping_);
+    CloseHandle(file_);
+    throw runtime_error(string("Cannot map ") + filename);
+  }
+}
+
+MappedFile::~MappedFile() {
+  UnmapViewOfFile(data_);
+  CloseHandle(mapping_);
+  CloseHandle(file_);
+}
+
+#else
+
+MappedFile::MappedFile(const char* filename) : data_(NULL), size_(0) {
+  const int fd = open(filename, O_RDONLY);
+  if (fd < 0)
+    throw runtime_error(string("Cannot open ") + filename);
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    throw runtime_error(string("Cannot map empty file ") + filename);
+  }
+  size_ = static_cast<size_t>(st.st_size);
+
+  void* p = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd); // the mapping keeps the file
+  if (p == MAP_FAILED)
+    throw runtime_error(string("Cannot map ") + filename);
+  data_ = static_cast<const unsigned char*>(p);
+}
+
+MappedFile::~MappedFile() {
+  munmap(const_cast<unsigned char*>(data_), size_);
+}
+
+#endif
+
+// Whether [offset, offset + count * size) lies inside a file of fileSize bytes
+static bool inFile(unsigned long long offset, unsigned long long count, unsigned long long size,
+                   unsigned long long fileSize) {
+  return offset <= fileSize && count <= (fileSize - offset) / (size ? size : 1) &&
+    offset % SCENE_FILE_ALIGNMENT == 0;
+}
+
+// Whether every one of n indices of the given size is below numVertices
+static bool indicesInRange(const unsigned char* idx, unsigned n, unsigned size, unsigned numVertices) {
+  for (unsigned i = 0; i < n; ++i, idx += size) {
+    unsigned v = 0;
+    memcpy(&v, idx, size);   // little endian
+    if (v >= numVertices)
+      return false;
+  }
+  return true;
+}
+
+SceneFile::SceneFile(const char* filename, bool verify) : file_(filename) {
+  if (file_.size() < sizeof(SceneFileHeader))
+    throw runtime_error(string("Truncated scene file ") + filename);
+  header_ = reinterpret_cast<const SceneFileHeader*>(file_.data());
+
+  if (memcmp(header_->magic, SCENE_FILE_MAGIC, sizeof(SCENE_FILE_MAGIC)) != 0)
+    throw runtime_error(string("Not a scene file: ") + filename);
+  if (header_->version != SCENE_FILE_VERSION)
+    throw runtime_error(string("Unsupported scene file version in ") + filename);
+
+  const unsigned long long size = file_.size();
+  if (header_->fileSize != size ||
+      !inFile(header_->meshOffset, header_->numMeshes, sizeof(SceneFileMesh), size) ||
+      !inFile(header_->nodeOffset, header_->numNodes, sizeof(SceneFileNode), size) ||
+      !inFile(header_->materialOffset, header_->numMaterials, sizeof(SceneFileMaterial), size) ||
+      !inFile(header_->cellOffset, header_->numCells, sizeof(SceneFileCell), size) ||
+      !inFile(header_->portalOffset, header_->numPortals, sizeof(SceneFilePortal), size))
+    throw runtime_error(string("Corrupt scene file ") + filename);
+
+  for (int i = 0; i < numMeshes(); ++i) {
+    const SceneFileMesh& m = mesh(i);
+    if (m.vertexStride != sceneVertexSize(m.vertexFormat) || sceneIndexSize(m.indexType) == 0)
+      throw runtime_error(string("Unsupported mesh layout in scene file ") + filename);
+    if (!inFile(m.vertexOffset, m.numVertices, m.vertexStride, size) ||
+        !inFile(m.indexOffset, m.numIndices, sceneIndexSize(m.indexType), size) ||
+        (m.material >= header_->numMaterials && header_->numMaterials > 0))
+      throw runtime_error(string("Corrupt mesh in scene file ") + filename);
+
+    if (verify && !indicesInRange(static_cast<const unsigned char*>(indices(i)), m.numIndices,
+                                  sceneIndexSize(m.indexType), m.numVertices))
+      throw runtime_error(string("Index out of range in scene file ") + filename);
+
+    // a level follows the next finer one and is used below its size (see LodChain)
+    if (m.lodLevel != 0 &&
+        (i == 0 || m.lodLevel != mesh(i - 1).lodLevel + 1 || !(m.lodMinSize < mesh(i - 1).lodMinSize)))
+      throw runtime_error(string("Broken level of detail chain in scene file ") + filename);
+  }
+  for (int i = 0; i < numNodes(); ++i) {
+    if (node(i).mesh >= header_->numMeshes)
+      throw runtime_error(string("Corrupt node in scene file ") + filename);
+  }
+  for (int i = 0; i < numMaterials(); ++i) {
+    if (!memchr(material(i).texture, 0, sizeof(material(i).texture)))
+      throw runtime_error(string("Corrupt material in scene file ") + filename);
+  }
+  for (int i = 0; i < numPortals(); ++i) {
+    const SceneFilePortal& p = portal(i);
+    if (p.cells[0] >= header_->numCells || p.cells[1] >= header_->numCells || p.cells[0] == p.cells[1])
+      throw runtime_error(string("Corrupt portal in scene file ") + filename);
+  }
+}
+
+int SceneFileWriter::addMaterial(const char* texture) {
+  SceneFileMaterial m;
+  memset(&m, 0, sizeof(m));
+  strncpy(m.texture, texture, sizeof(m.texture) - 1);
+  materials_.push_back(m);
+  return static_cast<int>(materials_.size()) - 1;
+}
+
+int SceneFileWriter::addMesh(const SceneFileMesh& desc, const void* vertices, unsigned numVertices,
+                             const void* indices, unsigned numIndices) {
+  SceneFileMesh m = desc;
+  m.numVertices = numVertices;
+  m.numIndices = numIndices;
+  m.vertexOffset = m.indexOffset = 0;
+  meshes_.push_back(m);
+
+  const unsigned char* v = static_cast<const unsigned char*>(vertices);
+  vertexBlobs_.push_back(vector<unsigned char>(v, v + static_cast<size_t>(numVertices) * desc.vertexStride));
+  const unsigned char* i = static_cast<const unsigned char*>(indices);
+  indexBlobs_.push_back(vector<unsigned char>(i, i + static_cast<size_t>(numIndices) * sceneIndexSize(desc.indexType)));
+  return static_cast<int>(meshes_.size()) - 1;
+}
+
+int SceneFileWriter::addNode(const SceneFileNode& node) {
+  nodes_.push_back(node);
+  return static_cast<int>(nodes_.size()) - 1;
+}
+
+int SceneFileWriter::addCell(const SceneFileCell& cell) {
+  cells_.push_back(cell);
+  return static_cast<int>(cells_.size()) - 1;
+}
+
+int SceneFileWriter::addPortal(const SceneFilePortal& portal) {
+  portals_.push_back(portal);
+  return static_cast<int>(portals_.size()) - 1;
+}
+
+static unsigned long long alignUp(unsigned long long offset) {
+  return (offset + SCENE_FILE_ALIGNMENT - 1) / SCENE_FILE_ALIGNMENT * SCENE_FILE_ALIGNMENT;
+}
+
+void SceneFileWriter::write(const char* filename) const {
+  // lay out the sections
+  SceneFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SCENE_FILE_MAGIC, sizeof(header.magic));
+  header.version = SCENE_FILE_VERSION;
+  header.numMeshes = static_cast<unsigned>(meshes_.size());
+  header.numNodes = static_cast<unsigned>(nodes_.size());
+  header.numMaterials = static_cast<unsigned>(materials_.size());
+  header.numCells = static_cast<unsigned>(cells_.size());
+  header.numPortals = static_cast<unsigned>(portals_.size());
+
+  unsigned long long offset = alignUp(sizeof(header));
+  header.meshOffset = offset;
+  offset = alignUp(offset + sizeof(SceneFileMesh) * meshes_.size());
+  header.nodeOffset = offset;
+  offset = alignUp(offset + sizeof(SceneFileNode) * nodes_.size());
+  header.materialOffset = offset;
+  offset = alignUp(offset + sizeof(SceneFileMaterial) * materials_.size());
+  header.cellOffset = offset;
+  offset = alignUp(offset + sizeof(SceneFileCell) * cells_.size());
+  header.portalOffset = offset;
+  offset = alignUp(offset + sizeof(SceneFilePortal) * portals_.size());
+
+  vector<SceneFileMesh> meshes(meshes_);
+  for (size_t i = 0; i < meshes.size(); ++i) {
+    meshes[i].vertexOffset = offset;
+    offset = alignUp(offset + vertexBlobs_[i].size());
+    meshes[i].indexOffset = offset;
+    offset = alignUp(offset + indexBlobs_[i].size());
+  }
+  header.fileSize = offset;
+
+  // and write them, padding up to every offset
+  ofstream f(filename, ios::binary);
+  if (!f)
+    throw runtime_error(string("Cannot create ") + filename);
+  unsigned long long written = 0;
+  const char zeros[SCENE_FILE_ALIGNMENT] = { 0 };
+  struct Out {
+    ofstream& f;
+    unsigned long long& written;
+    const char* zeros;
+
+    void operator () (unsigned long long at, const void* data, size_t size) {
+      f.write(zeros, static_cast<streamsize>(at - written));
+      if (size)
+        f.write(static_cast<const char*>(data), static_cast<streamsize>(size));
+      written = at + size;
+    }
+  } out = { f, written, zeros };
+
+  out(0, &header, sizeof(header));
+  if (!meshes.empty())
+    out(header.meshOffset, &meshes[0], sizeof(SceneFileMesh) * meshes.size());
+  if (!nodes_.empty())
+    out(header.nodeOffset, &nodes_[0], sizeof(SceneFileNode) * nodes_.size());
+  if (!materials_.empty())
+    out(header.materialOffset, &materials_[0], sizeof(SceneFileMaterial) * materials_.size());
+  if (!cells_.empty())
+    out(header.cellOffset, &cells_[0], sizeof(SceneFileCell) * cells_.size());
+  if (!portals_.empty())
+    out(header.portalOffset, &portals_[0], sizeof(SceneFilePortal) * portals_.size());
+  for (size_t i = 0; i < meshes.size(); ++i) {
+    if (!vertexBlobs_[i].empty())
+      out(meshes[i].vertexOffset, &vertexBlobs_[i][0], vertexBlobs_[i].size());
+    if (!indexBlobs_[i].empty())
+      out(meshes[i].indexOffset, &indexBlobs_[i][0], indexBlobs_[i].size());
+  }
+  out(header.fileSize, NULL, 0);
+
+  if (!f)
+    throw runtime_error(string("Cannot write ") + filename);
+}
@@ -0,0 +1,220 @@
+#ifndef SCENEFILE_H
+#define SCENEFILE_H
+
+#include <cstddef>
+#include <vector>
+
+//--------------------------------------------------------------------------------
+// Binary scene file: meshes, materials, nodes and the cells and portals of
+// the level in one versioned container.
+//
+// The file is a header followed by tables of fixed size records and by the
+// vertex and index blobs, every section aligned to SCENE_FILE_ALIGNMENT. It is
+// used in place after mapping it into memory: the blobs are stored in the
+// layout GL fetches, so they go straight to glBufferData, and the records are
+// read as they are. All values are little endian.
+//--------------------------------------------------------------------------------
+
+
+static const char SCENE_FILE_MAGIC[4] = { 'C', 'G', 'M', 'S' };
+static const unsigned SCENE_FILE_VERSION = 3;
+static const unsigned SCENE_FILE_ALIGNMENT = 16;
+
+struct SceneFileHeader {
+  char magic[4];
+  unsigned version;
+  unsigned numMeshes, numNodes, numMaterials, numCells, numPortals, reserved;
+  unsigned long long meshOffset, nodeOffset, materialOffset, cellOffset, portalOffset;
+  unsigned long long fileSize;
+};
+
+enum SceneFileVertexFormat {
+  SCENE_VERTEX_PNT = 0,         // 3 float position, 3 float normal, 2 float texture coordinate; 32 bytes
+  SCENE_VERTEX_PNT_PACKED = 1   // 4 normalized shorts of position relative to packLo..packHi (w unused),
+                                // GL_INT_2_10_10_10_REV normal, 2 half float texture coordinate; 16 bytes
+};
+
+// Types of triangle list indices, with the values of the GL enums so they can
+// be given to glDrawElements as they are
+enum SceneFileIndexType {
+  SCENE_INDEX_UNSIGNED_BYTE = 0x1401,
+  SCENE_INDEX_UNSIGNED_SHORT = 0x1403,
+  SCENE_INDEX_UNSIGNED_INT = 0x1405
+};
+
+// Bytes per vertex of a SceneFileVertexFormat, 0 for an unknown format
+inline unsigned sceneVertexSize(unsigned format) {
+  return format == SCENE_VERTEX_PNT ? 32 : (format == SCENE_VERTEX_PNT_PACKED ? 16 : 0);
+}
+
+// Bytes per index of a SceneFileIndexType, 0 for an unknown type
+inline unsigned sceneIndexSize(unsigned type) {
+  return type == SCENE_INDEX_UNSIGNED_BYTE ? 1 : type == SCENE_INDEX_UNSIGNED_SHORT ? 2 :
+    (type == SCENE_INDEX_UNSIGNED_INT ? 4 : 0);
+}
+
+// A mesh: vertices of vertexStride bytes in vertexFormat and triangle list
+// indices of indexType. The levels of a level of detail chain are
+// consecutive meshes, level 0 first.
+struct SceneFileMesh {
+  unsigned long long vertexOffset, indexOffset;   // from the start of the file
+  unsigned numVertices, numIndices;
+  unsigned vertexStride;
+  unsigned vertexFormat;   // SceneFileVertexFormat
+  unsigned indexType;      // SceneFileIndexType
+  unsigned material;
+  unsigned lodLevel;       // 0 for the finest level, or for a mesh without levels
+  float lodMinSize;        // pixels down to which this level is used (see LodChain)
+  float boundsLo[3], boundsHi[3];
+  float packLo[3], packHi[3];   // box its positions are packed relative to
+};
+
+enum SceneFileNodeFlags {
+  SCENE_NODE_COLLIDER = 1,   // part of the walls the camera collides with
+  SCENE_NODE_LODS = 2        // drawn through the level of detail chain starting at mesh
+};
+
+struct SceneFileNode {
+  double rbt[16];          // object to world, row-major
+  float boundsLo[3], boundsHi[3];   // world box
+  unsigned mesh;
+  unsigned flags;          // SceneFileNodeFlags
+};
+
+struct SceneFileMaterial {
+  char texture[64];        // file name, NUL terminated
+};
+
+// A cell for portal culling (see CellPortalGraph): a box the eye can be in,
+// or an empty box (lo above hi) for a cell only seen through portals, e.g.
+// the outside. A scene without cells is culled without portals.
+struct SceneFileCell {
+  float boundsLo[3], boundsHi[3];
+};
+
+// An opening between two cells: an axis aligned rectangle, given as a box that
+// is flat along one axis
+struct SceneFilePortal {
+  unsigned cells[2];
+  float rectLo[3], rectHi[3];
+};
+
+// Read-only memory mapping of a whole file. Throws runtime_error on error.
+class MappedFile {
+  const unsigned char* data_;
+  size_t size_;
+#ifdef _WIN32
+  void* file_;
+  void* mapping_;
+#endif
+
+  MappedFile(const MappedFile&);
+  MappedFile& operator = (const MappedFile&);
+
+public:
+  explicit MappedFile(const char* filename);
+  ~MappedFile();
+
+  const unsigned char* data() const {
+    return data_;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+};
+
+// A scene file mapped into memory. The constructor checks the header, that
+// every table and blob lies inside the file, the vertex formats and index
+// types are known, every level of detail chain is ordered and every texture
+// name is terminated and every portal connects two cells, and throws
+// runtime_error if not. With verify it also
+// checks that every index refers to a vertex of its mesh, which reads all of
+// them.
+class SceneFile {
+  MappedFile file_;
+  const SceneFileHeader* header_;
+
+public:
+  explicit SceneFile(const char* filename, bool verify = false);
+
+  int numMeshes() const {
+    return static_cast<int>(header_->numMeshes);
+  }
+
+  int numNodes() const {
+    return static_cast<int>(header_->numNodes);
+  }
+
+  int numMaterials() const {
+    return static_cast<int>(header_->numMaterials);
+  }
+
+  int numCells() const {
+    return static_cast<int>(header_->numCells);
+  }
+
+  int numPortals() const {
+    return static_cast<int>(header_->numPortals);
+  }
+
+  const SceneFileMesh& mesh(int i) const {
+    return reinterpret_cast<const SceneFileMesh*>(file_.data() + header_->meshOffset)[i];
+  }
+
+  const SceneFileNode& node(int i) const {
+    return reinterpret_cast<const SceneFileNode*>(file_.data() + header_->nodeOffset)[i];
+  }
+
+  const SceneFileMaterial& material(int i) const {
+    return reinterpret_cast<const SceneFileMaterial*>(file_.data() + header_->materialOffset)[i];
+  }
+
+  const SceneFileCell& cell(int i) const {
+    return reinterpret_cast<const SceneFileCell*>(file_.data() + header_->cellOffset)[i];
+  }
+
+  const SceneFilePortal& portal(int i) const {
+    return reinterpret_cast<const SceneFilePortal*>(file_.data() + header_->portalOffset)[i];
+  }
+
+  const void* vertices(int mesh) const {
+    return file_.data() + this->mesh(mesh).vertexOffset;
+  }
+
+  const void* indices(int mesh) const {
+    return file_.data() + this->mesh(mesh).indexOffset;
+  }
+};
+
+// Collects meshes, materials, nodes, cells and portals, then lays them out as
+// a scene file
+class SceneFileWriter {
+  std::vector<SceneFileMesh> meshes_;
+  std::vector<SceneFileNode> nodes_;
+  std::vector<SceneFileMaterial> materials_;
+  std::vector<SceneFileCell> cells_;
+  std::vector<SceneFilePortal> portals_;
+  std::vector<std::vector<unsigned char> > vertexBlobs_;
+  std::vector<std::vector<unsigned char> > indexBlobs_;
+
+public:
+  int addMaterial(const char* texture);
+
+  // Adds a mesh described by desc, whose offsets and counts are filled in
+  // here. The vertices are of desc.vertexStride bytes, the indices of
+  // desc.indexType.
+  int addMesh(const SceneFileMesh& desc, const void* vertices, unsigned numVertices,
+              const void* indices, unsigned numIndices);
+
+  int addNode(const SceneFileNode& node);
+
+  int addCell(const SceneFileCell& cell);
+
+  int addPortal(const SceneFilePortal& portal);
+
+  // Throws runtime_error on error
+  void write(const char* filename) const;
+};
+
+#endif
@@ -0,0 +1,222 @@
+#ifndef WORLDSTREAM_H
+#define WORLDSTREAM_H
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "cvec.h"
+
+//--------------------------------------------------------------------------------
+// Paging of the tiles of a world grid in and out around a moving eye
+//--------------------------------------------------------------------------------
+
+
+// Tile (x, z) covers [(x - 0.5) * size, (x + 0.5) * size] on the x axis and
+// likewise on z, so tile (0, 0) is centered on the origin
+struct TileCoord {
+  int x, z;
+
+  TileCoord(int x = 0, int z = 0) : x(x), z(z) {}
+
+  bool operator < (const TileCoord& t) const {
+    return x < t.x || (x == t.x && z < t.z);
+  }
+
+  bool operator == (const TileCoord& t) const {
+    return x == t.x && z == t.z;
+  }
+};
+
+// Keeps the tiles within a radius of the eye resident. Tiles are built by the
+// loader on a background thread, nearest first, and handed to the caller of
+// update on its own thread, e.g., to upload them to GL. Tile must have a
+// size_t bytes() const. Once the resident tiles exceed the memory budget the
+// least recently wanted ones are evicted; tiles wanted this frame never are,
+// and no new loads start while over budget.
+template<typename Tile>
+class TileStreamer {
+public:
+  typedef std::function<std::shared_ptr<Tile>(const TileCoord&)> Loader;
+  typedef std::pair<TileCoord, std::shared_ptr<Tile> > Entry;
+
+  TileStreamer(double tileSize, double radius, size_t budgetBytes, const Loader& loader)
+    : tileSize_(tileSize), radius_(radius), budget_(budgetBytes), loader_(loader),
+      residentBytes_(0), frame_(0), stop_(false), loading_(false) {
+    worker_ = std::thread(&TileStreamer::work, this);
+  }
+
+  ~TileStreamer() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    wake_.notify_one();
+    worker_.join();
+  }
+
+  double tileSize() const {
+    return tileSize_;
+  }
+
+  size_t residentBytes() const {
+    return residentBytes_;
+  }
+
+  int numResident() const {
+    return static_cast<int>(resident_.size());
+  }
+
+  TileCoord tileAt(const Cvec3& p) const {
+    return TileCoord(static_cast<int>(std::floor(p[0] / tileSize_ + 0.5)),
+                     static_cast<int>(std::floor(p[2] / tileSize_ + 0.5)));
+  }
+
+  // The resident tile at t, or NULL
+  Tile* find(const TileCoord& t) const {
+    const typename Map::const_iterator i = resident_.find(t);
+    return i == resident_.end() ? NULL : i->second.tile.get();
+  }
+
+  // Calls fn(coord, tile) for every resident tile
+  template<typename Fn>
+  void forEach(Fn fn) const {
+    for (typename Map::const_iterator i = resident_.begin(); i != resident_.end(); ++i)
+      fn(i->first, *i->second.tile);
+  }
+
+  // Once per frame: marks the tiles near eye as wanted and queues the missing
+  // ones, nearest first. Appends the tiles finished since the last call to
+  // loaded and the ones dropped to evicted; the streamer keeps owning both
+  // until evicted tiles are released by the caller.
+  void update(const Cvec3& eye, std::vector<Entry>& loaded, std::vector<Entry>& evicted) {
+    ++frame_;
+
+    // wanted tiles, nearest first
+    const TileCoord center = tileAt(eye);
+    const int r = static_cast<int>(std::ceil(radius_ / tileSize_));
+    std::vector<std::pair<double, TileCoord> > wanted;
+    for (int z = center.z - r; z <= center.z + r; ++z) {
+      for (int x = center.x - r; x <= center.x + r; ++x) {
+        const double dx = std::max(std::fabs(x * tileSize_ - eye[0]) - tileSize_ / 2, 0.0);
+        const double dz = std::max(std::fabs(z * tileSize_ - eye[2]) - tileSize_ / 2, 0.0);
+        if (dx * dx + dz * dz <= radius_ * radius_)
+          wanted.push_back(std::make_pair(dx * dx + dz * dz, TileCoord(x, z)));
+      }
+    }
+    std::sort(wanted.begin(), wanted.end());
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // adopt the finished tiles that are still wanted
+    for (size_t i = 0; i < done_.size(); ++i) {
+      bool stillWanted = false;
+      for (size_t j = 0; j < wanted.size() && !stillWanted; ++j)
+        stillWanted = wanted[j].second == done_[i].first;
+      if (!stillWanted || resident_.count(done_[i].first))
+        continue;
+      Resident& res = resident_[done_[i].first];
+      res.tile = done_[i].second;
+      res.bytes = res.tile->bytes();
+      lru_.push_front(done_[i].first);
+      res.lru = lru_.begin();
+      residentBytes_ += res.bytes;
+      loaded.push_back(done_[i]);
+    }
+    done_.clear();
+
+    // touch the wanted resident tiles
+    std::vector<TileCoord> missing;
+    for (size_t i = 0; i < wanted.size(); ++i) {
+      const typename Map::iterator res = resident_.find(wanted[i].second);
+      if (res != resident_.end()) {
+        res->second.used = frame_;
+        lru_.splice(lru_.begin(), lru_, res->second.lru);
+      }
+      else if (!(loading_ && current_ == wanted[i].second)) {
+        missing.push_back(wanted[i].second);
+      }
+    }
+
+    // evict from the least recently wanted end, down to the budget or to make
+    // room for the missing tiles
+    while ((residentBytes_ > budget_ || (residentBytes_ == budget_ && !missing.empty())) && !lru_.empty()) {
+      const typename Map::iterator res = resident_.find(lru_.back());
+      if (res->second.used == frame_)
+        break;
+      evicted.push_back(Entry(res->first, res->second.tile));
+      residentBytes_ -= res->second.bytes;
+      lru_.pop_back();
+      resident_.erase(res);
+    }
+
+    queue_.clear();
+    if (residentBytes_ < budget_)
+      queue_.swap(missing);
+
+    if (!queue_.empty())
+      wake_.notify_one();
+  }
+
+private:
+  struct Resident {
+    std::shared_ptr<Tile> tile;
+    size_t bytes;
+    unsigned long long used;              // frame it was last wanted in
+    typename std::list<TileCoord>::iterator lru;
+
+    Resident() : bytes(0), used(0) {}
+  };
+  typedef std::map<TileCoord, Resident> Map;
+
+  void work() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+      wake_.wait(lock, [this]() { return stop_ || !queue_.empty(); });
+      if (stop_)
+        return;
+      current_ = queue_.front();
+      queue_.erase(queue_.begin());
+      loading_ = true;
+
+      lock.unlock();
+      std::shared_ptr<Tile> tile = loader_(current_);
+      lock.lock();
+
+      loading_ = false;
+      if (tile)
+        done_.push_back(Entry(current_, tile));
+    }
+  }
+
+  const double tileSize_, radius_;
+  const size_t budget_;
+  const Loader loader_;
+
+  // main thread only
+  Map resident_;
+  std::list<TileCoord> lru_;            // most recently wanted first
+  size_t residentBytes_;
+  unsigned long long frame_;
+
+  // shared with the worker, under mutex_
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::vector<TileCoord> queue_;        // nearest first, replaced every update
+  std::vector<Entry> done_;
+  TileCoord current_;
+  bool stop_, loading_;
+
+  std::thread worker_;
+};
+
+#endif
@@ -0,0 +1,402 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <regex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+//--------------------------------------------------------------------------------
+// A microbenchmark harness with the interface of Google Benchmark, for Linux
+//--------------------------------------------------------------------------------
+
+// Implements the part of the Google Benchmark API the benchmarks here use, so
+// they also build against the real library unchanged:
+//
+//   class Batch : public benchmark::Fixture {
+//   public:
+//     void SetUp(const benchmark::State& state) override { ... state.range(0) ... }
+//   };
+//
+//   BENCHMARK_DEFINE_F(Batch, Add)(benchmark::State& state) {
+//     for (auto _ : state) { ... }
+//     state.SetItemsProcessed(state.iterations() * state.range(0));
+//   }
+//   BENCHMARK_REGISTER_F(Batch, Add)->RangeMultiplier(8)->Range(1, 1 << 20);
+//
+//   BENCHMARK_MAIN();
+//
+// Every benchmark runs with each of its arguments for growing iteration
+// counts until a run takes --benchmark_min_time seconds of CPU time, and
+// reports that run. --benchmark_out writes the results as Google Benchmark
+// JSON, so two runs can be compared with its tools/compare.py.
+
+namespace benchmark {
+
+// Keeps the compiler from optimizing away the computation of value
+template <typename T>
+inline void DoNotOptimize(const T& value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// Makes all pending writes to memory happen
+inline void ClobberMemory() {
+  asm volatile("" : : : "memory");
+}
+
+inline double processCpuSeconds() {
+  timespec t;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+class State {
+public:
+  State(long long iterations, const std::vector<long long>& args)
+    : iterations_(iterations), remaining_(iterations), args_(args), items_(0), bytes_(0),
+      realSeconds_(0), cpuSeconds_(0) {}
+
+  long long range(int i = 0) const {
+    return args_[i];
+  }
+
+  long long iterations() const {
+    return iterations_;
+  }
+
+  void SetItemsProcessed(long long items) {
+    items_ = items;
+  }
+
+  void SetBytesProcessed(long long bytes) {
+    bytes_ = bytes;
+  }
+
+  // The loop of `for (auto _ : state)`, timed from begin to the last test.
+  // Marked unused so the loop variable raises no warning.
+  struct __attribute__((unused)) Value {};
+
+  class Iterator {
+    State* state_;
+
+  public:
+    explicit Iterator(State* state) : state_(state) {}
+
+    Value operator * () const {
+      return Value();
+    }
+
+    Iterator& operator ++ () {
+      --state_->remaining_;
+      return *this;
+    }
+
+    bool operator != (const Iterator&) const {
+      if (state_->remaining_ > 0)
+        return true;
+      state_->stopTimer();
+      return false;
+    }
+  };
+
+  Iterator begin() {
+    startTime_ = Clock::now();
+    startCpu_ = processCpuSeconds();
+    return Iterator(this);
+  }
+
+  Iterator end() {
+    return Iterator(this);
+  }
+
+  double realSeconds() const {
+    return realSeconds_;
+  }
+
+  double cpuSeconds() const {
+    return cpuSeconds_;
+  }
+
+  long long items() const {
+    return items_;
+  }
+
+  long long bytes() const {
+    return bytes_;
+  }
+
+private:
+  typedef std::chrono::steady_clock Clock;
+
+  void stopTimer() {
+    realSeconds_ = std::chrono::duration<double>(Clock::now() - startTime_).count();
+    cpuSeconds_ = processCpuSeconds() - startCpu_;
+  }
+
+  long long iterations_, remaining_;
+  std::vector<long long> args_;
+  long long items_, bytes_;
+  Clock::time_point startTime_;
+  double startCpu_;
+  double realSeconds_, cpuSeconds_;
+};
+
+// Per-benchmark data, set up before and torn down after every run
+class Fixture {
+public:
+  virtual ~Fixture() {}
+  virtual void SetUp(const State&) {}
+  virtual void TearDown(const State&) {}
+  virtual void BenchmarkCase(State& state) = 0;
+};
+
+class Benchmark {
+public:
+  Benchmark(const char* name, Fixture* fixture) : name_(name), fixture_(fixture), multiplier_(8) {}
+
+  Benchmark* Arg(long long x) {
+    args_.push_back(x);
+    return this;
+  }
+
+  Benchmark* RangeMultiplier(int multiplier) {
+    multiplier_ = std::max(multiplier, 2);
+    return this;
+  }
+
+  // lo, then the powers of the multiplier between, then hi
+  Benchmark* Range(long long lo, long long hi) {
+    args_.push_back(lo);
+    long long x = 1;
+    while (x <= lo)
+      x *= multiplier_;
+    for (; x < hi; x *= multiplier_)
+      args_.push_back(x);
+    if (hi > lo)
+      args_.push_back(hi);
+    return this;
+  }
+
+  Benchmark* Apply(void (*fn)(Benchmark*)) {
+    fn(this);
+    return this;
+  }
+
+  const std::string& name() const {
+    return name_;
+  }
+
+  const std::vector<long long>& args() const {
+    return args_;
+  }
+
+  Fixture& fixture() {
+    return *fixture_;
+  }
+
+private:
+  std::string name_;
+  std::unique_ptr<Fixture> fixture_;
+  int multiplier_;
+  std::vector<long long> args_;
+};
+
+inline std::vector<std::unique_ptr<Benchmark> >& registry() {
+  static std::vector<std::unique_ptr<Benchmark> > benchmarks;
+  return benchmarks;
+}
+
+inline Benchmark* registerBenchmark(const char* name, Fixture* fixture) {
+  registry().push_back(std::unique_ptr<Benchmark>(new Benchmark(name, fixture)));
+  return registry().back().get();
+}
+
+struct Result {
+  std::string name;
+  int family, instance;
+  long long iterations;
+  double realNs, cpuNs;         // per iteration
+  double itemsPerSecond, bytesPerSecond;
+
+  Result() : family(0), instance(0), iterations(0), realNs(0), cpuNs(0), itemsPerSecond(0), bytesPerSecond(0) {}
+};
+
+// Runs the fixture with arg for more and more iterations until a run takes minTime
+inline Result runBenchmark(Benchmark& b, long long arg, double minTime) {
+  const std::vector<long long> args(1, arg);
+  long long iterations = 1;
+  for (;;) {
+    State state(iterations, args);
+    b.fixture().SetUp(state);
+    b.fixture().BenchmarkCase(state);
+    b.fixture().TearDown(state);
+
+    const double seconds = state.cpuSeconds();
+    if (seconds >= minTime || iterations >= 1000000000) {
+      Result r;
+      r.iterations = iterations;
+      r.realNs = state.realSeconds() * 1e9 / iterations;
+      r.cpuNs = seconds * 1e9 / iterations;
+      r.itemsPerSecond = seconds > 0 ? state.items() / seconds : 0;
+      r.bytesPerSecond = seconds > 0 ? state.bytes() / seconds : 0;
+      return r;
+    }
+
+    // aim past minTime, growing at most tenfold while the run is too short to trust
+    double multiplier = minTime * 1.4 / std::max(seconds, 1e-9);
+    if (seconds / minTime <= 0.1)
+      multiplier = std::min(multiplier, 10.0);
+    if (multiplier <= 1)
+      multiplier = 2;
+    iterations = std::min(std::max(static_cast<long long>(multiplier * iterations), iterations + 1), 1000000000LL);
+  }
+}
+
+inline void writeJson(FILE* f, const char* executable, const std::vector<Result>& results) {
+  char date[64], host[256] = "";
+  const std::time_t now = std::time(NULL);
+  std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", std::localtime(&now));
+  gethostname(host, sizeof(host) - 1);
+
+  fprintf(f, "{\n  \"context\": {\n");
+  fprintf(f, "    \"date\": \"%s\",\n", date);
+  fprintf(f, "    \"host_name\": \"%s\",\n", host);
+  fprintf(f, "    \"executable\": \"%s\",\n", executable);
+  fprintf(f, "    \"num_cpus\": %u,\n", std::thread::hardware_concurrency());
+#ifdef BENCH_COMMIT
+  fprintf(f, "    \"git_commit\": \"%s\",\n", BENCH_COMMIT);
+#endif
+#ifdef NDEBUG
+  fprintf(f, "    \"library_build_type\": \"release\"\n");
+#else
+  fprintf(f, "    \"library_build_type\": \"debug\"\n");
+#endif
+  fprintf(f, "  },\n  \"benchmarks\": [");
+  for (size_t i = 0; i < results.size(); ++i) {
+    const Result& r = results[i];
+    fprintf(f, "%s\n    {\n", i ? "," : "");
+    fprintf(f, "      \"name\": \"%s\",\n", r.name.c_str());
+    fprintf(f, "      \"family_index\": %d,\n", r.family);
+    fprintf(f, "      \"per_family_instance_index\": %d,\n", r.instance);
+    fprintf(f, "      \"run_name\": \"%s\",\n", r.name.c_str());
+    fprintf(f, "      \"run_type\": \"iteration\",\n");
+    fprintf(f, "      \"repetitions\": 1,\n      \"repetition_index\": 0,\n      \"threads\": 1,\n");
+    fprintf(f, "      \"iterations\": %lld,\n", r.iterations);
+    fprintf(f, "      \"real_time\": %.6e,\n", r.realNs);
+    fprintf(f, "      \"cpu_time\": %.6e,\n", r.cpuNs);
+    fprintf(f, "      \"time_unit\": \"ns\"");
+    if (r.itemsPerSecond > 0)
+      fprintf(f, ",\n      \"items_per_second\": %.6e", r.itemsPerSecond);
+    if (r.bytesPerSecond > 0)
+      fprintf(f, ",\n      \"bytes_per_second\": %.6e", r.bytesPerSecond);
+    fprintf(f, "\n    }");
+  }
+  fprintf(f, "\n  ]\n}\n");
+}
+
+// Takes --benchmark_filter=<regex>, --benchmark_min_time=<seconds>,
+// --benchmark_out=<file> and --benchmark_list_tests. Returns the exit code.
+inline int runSpecifiedBenchmarks(int argc, char* argv[]) {
+  std::string filter = ".", out;
+  double minTime = 0.5;
+  bool list = false;
+  for (int i = 1; i < argc; ++i) {
+    const char* a = argv[i];
+    if (strncmp(a, "--benchmark_filter=", 19) == 0)
+      filter = a + 19;
+    else if (strncmp(a, "--benchmark_min_time=", 21) == 0)
+      minTime = atof(a + 21);   // a trailing 's' is ignored
+    else if (strncmp(a, "--benchmark_out=", 16) == 0)
+      out = a + 16;
+    else if (strcmp(a, "--benchmark_list_tests") == 0 || strcmp(a, "--benchmark_list_tests=true") == 0)
+      list = true;
+    else {
+      fprintf(stderr, "Unknown flag %s\n", a);
+      return 1;
+    }
+  }
+
+  std::regex pattern;
+  try {
+    pattern = std::regex(filter);
+  }
+  catch (const std::regex_error&) {
+    fprintf(stderr, "Bad --benchmark_filter %s\n", filter.c_str());
+    return 1;
+  }
+
+  std::vector<Result> results;
+  if (!list)
+    printf("%-48s %14s %14s %12s %14s\n", "Benchmark", "Time", "CPU", "Iterations", "Items/s");
+  int family = 0;
+  for (size_t i = 0; i < registry().size(); ++i) {
+    Benchmark& b = *registry()[i];
+    bool any = false;
+    for (size_t k = 0; k < b.args().size(); ++k) {
+      const std::string name = b.name() + "/" + std::to_string(b.args()[k]);
+      if (!std::regex_search(name, pattern))
+        continue;
+      any = true;
+      if (list) {
+        printf("%s\n", name.c_str());
+        continue;
+      }
+      Result r = runBenchmark(b, b.args()[k], minTime);
+      r.name = name;
+      r.family = family;
+      r.instance = static_cast<int>(k);
+      printf("%-48s %11.1f ns %11.1f ns %12lld %13.4gM\n", name.c_str(), r.realNs, r.cpuNs, r.iterations,
+             r.itemsPerSecond * 1e-6);
+      fflush(stdout);
+      results.push_back(r);
+    }
+    if (any)
+      ++family;
+  }
+
+  if (!out.empty()) {
+    FILE* f = fopen(out.c_str(), "w");
+    if (!f) {
+      fprintf(stderr, "Cannot write %s\n", out.c_str());
+      return 1;
+    }
+    writeJson(f, argv[0], results);
+    if (fclose(f) != 0) {
+      fprintf(stderr, "Cannot write %s\n", out.c_str());
+      return 1;
+    }
+  }
+  return 0;
+}
+
+}
+
+#define BENCHMARK_CONCAT2(a, b) a##b
+#define BENCHMARK_CONCAT(a, b) BENCHMARK_CONCAT2(a, b)
+
+#define BENCHMARK_DEFINE_F(BaseClass, Method)                  \
+  class BaseClass##_##Method##_Benchmark : public BaseClass {  \
+  public:                                                      \
+    void BenchmarkCase(::benchmark::State& state) override;    \
+  };                                                           \
+  void BaseClass##_##Method##_Benchmark::BenchmarkCase
+
+#define BENCHMARK_REGISTER_F(BaseClass, Method)                                          \
+  static ::benchmark::Benchmark* BENCHMARK_CONCAT(benchmarkRegistered, __LINE__) =      \
+    ::benchmark::registerBenchmark(#BaseClass "/" #Method, new BaseClass##_##Method##_Benchmark)
+
+#define BENCHMARK_MAIN()                                   \
+  int main(int argc, char* argv[]) {                       \
+    return ::benchmark::runSpecifiedBenchmarks(argc, argv); \
+  }
+
+#endif
@@ -0,0 +1,209 @@
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "cvec.h"
+#include "matrix4.h"
+#include "bench.h"
+
+// Microbenchmarks of cvec.h and matrix4.h of Assignment2-basic3d. Every
+// benchmark applies one operation to a batch of state.range(0) elements, from
+// 1 (the cost of a single call) up to 1M (bound by memory bandwidth), and
+// reports the items per second. See the Makefile for how to run and compare.
+
+using namespace std;
+
+// Batch sizes 1, 8, 64, ... 1M
+static void batchSizes(benchmark::Benchmark* b) {
+  b->RangeMultiplier(8)->Range(1, 1 << 20);
+}
+
+// Random vectors a and b, and room for the results
+class Cvec3Batch : public benchmark::Fixture {
+public:
+  vector<Cvec3> a, b, out;
+
+  void SetUp(const benchmark::State& state) override {
+    const size_t n = static_cast<size_t>(state.range(0));
+    mt19937 random(1);
+    uniform_real_distribution<double> coord(-10, 10);
+    a.resize(n);
+    b.resize(n);
+    out.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+      a[i] = Cvec3(coord(random), coord(random), coord(random));
+      b[i] = Cvec3(coord(random), coord(random), coord(random));
+    }
+  }
+
+  void TearDown(const benchmark::State&) override {
+    vector<Cvec3>().swap(a);
+    vector<Cvec3>().swap(b);
+    vector<Cvec3>().swap(out);
+  }
+};
+
+// Random rigid body transforms like the node transforms of the scene, a view
+// matrix, field of view angles, and room for the results
+class Matrix4Batch : public benchmark::Fixture {
+public:
+  vector<Matrix4> a, out;
+  vector<double> fovy;
+  vector<float> columnMajor;
+  Matrix4 view;
+
+  void SetUp(const benchmark::State& state) override {
+    const size_t n = static_cast<size_t>(state.range(0));
+    mt19937 random(1);
+    uniform_real_distribution<double> coord(-10, 10), angle(-180, 180), fov(30, 120);
+    a.resize(n);
+    out.resize(n);
+    fovy.resize(n);
+    columnMajor.resize(16 * n);
+    for (size_t i = 0; i < n; ++i) {
+      a[i] = Matrix4::makeTranslation(Cvec3(coord(random), coord(random), coord(random))) *
+        Matrix4::makeYRotation(angle(random)) * Matrix4::makeXRotation(angle(random));
+      fovy[i] = fov(random);
+    }
+    view = inv(Matrix4::makeTranslation(Cvec3(0, 1, 3)) * Matrix4::makeYRotation(30));
+  }
+
+  void TearDown(const benchmark::State&) override {
+    vector<Matrix4>().swap(a);
+    vector<Matrix4>().swap(out);
+    vector<double>().swap(fovy);
+    vector<float>().swap(columnMajor);
+  }
+};
+
+
+// --------- Cvec
+
+BENCHMARK_DEFINE_F(Cvec3Batch, Add)(benchmark::State& state) {
+  const size_t n = a.size();
+  for (auto _ : state) {
+    for (size_t i = 0; i < n; ++i)
+      out[i] = a[i] + b[i];
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK_REGISTER_F(Cvec3Batch, Add)->Apply(batchSizes);
+
+BENCHMARK_DEFINE_F(Cvec3Batch, Scale)(benchmark::State& state) {
+  const size_t n = a.size();
+  for (auto _ : state) {
+    for (size_t i = 0; i < n; ++i)
+      out[i] = a[i] * 0.5;
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK_REGISTER_F(Cvec3Batch, Scale)->Apply(batchSizes);
+
+BENCHMARK_DEFINE_F(Cvec3Batch, Dot)(benchmark::State& state) {
+  const size_t n = a.size();
+  for (auto _ : state) {
+    double sum = 0;
+    for (size_t i = 0; i < n; ++i)
+      sum += dot(a[i], b[i]);
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK_REGISTER_F(Cvec3Batch, Dot)->Apply(batchSizes);
+
+BENCHMARK_DEFINE_F(Cvec3Batch, Cross)(benchmark::State& state) {
+  const size_t n = a.size();
+  for (auto _ : state) {
+    for (size_t i = 0; i < n; ++i)
+      out[i] = cross(a[i], b[i]);
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK_REGISTER_F(Cvec3Batch, Cross)->Apply(batchSizes);
+
+BENCHMARK_DEFINE_F(Cvec3Batch, Normalize)(benchmark::State& state) {
+  const size_t n = a.size();
+  for (auto _ : state) {
+    for (size_t i = 0; i < n; ++i)
+      out[i] = normalize(a[i]);
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK_REGISTER_F(Cvec3Batch, Normalize)->Apply(batchSizes);
+
+
+// --------- Matrix4
+
+// the model view matrix of every node, as drawSceneNodes computes it
+BENCHMARK_DEFINE_F(Matrix4Batch, Multiply)(benchmark::State& state) {
+  const size_t n = a.size();
+  for (auto _ : state) {
+    for (size_t i = 0; i < n; ++i)
+      out[i] = view * a[i];
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK_REGISTER_F(Matrix4Batch, Multiply)->Apply(batchSizes);
+
+BENCHMARK_DEFINE_F(Matrix4Batch, Inv)(benchmark::State& state) {
+  const size_t n = a.size();
+  for (auto _ : state) {
+    for (size_t i = 0; i < n; ++i)
+      out[i] = inv(a[i]);
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK_REGISTER_F(Matrix4Batch, Inv)->Apply(batchSizes);
+
+BENCHMARK_DEFINE_F(Matrix4Batch, NormalMatrix)(benchmark::State& state) {
+  const size_t n = a.size();
+  for (auto _ : state) {
+    for (size_t i = 0; i < n; ++i)
+      out[i] = normalMatrix(a[i]);
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK_REGISTER_F(Matrix4Batch, NormalMatrix)->Apply(batchSizes);
+
+BENCHMARK_DEFINE_F(Matrix4Batch, Transpose)(benchmark::State& state) {
+  const size_t n = a.size();
+  for (auto _ : state) {
+    for (size_t i = 0; i < n; ++i)
+      out[i] = transpose(a[i]);
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK_REGISTER_F(Matrix4Batch, Transpose)->Apply(batchSizes);
+
+// what every draw does to send its matrices to the shaders
+BENCHMARK_DEFINE_F(Matrix4Batch, WriteToColumnMajorMatrix)(benchmark::State& state) {
+  const size_t n = a.size();
+  for (auto _ : state) {
+    for (size_t i = 0; i < n; ++i)
+      a[i].writeToColumnMajorMatrix(&columnMajor[16 * i]);
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK_REGISTER_F(Matrix4Batch, WriteToColumnMajorMatrix)->Apply(batchSizes);
+
+BENCHMARK_DEFINE_F(Matrix4Batch, MakeProjection)(benchmark::State& state) {
+  const size_t n = a.size();
+  for (auto _ : state) {
+    for (size_t i = 0; i < n; ++i)
+      out[i] = Matrix4::makeProjection(fovy[i], 16.0 / 9.0, -0.1, -50.0);
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK_REGISTER_F(Matrix4Batch, MakeProjection)->Apply(batchSizes);
+
+BENCHMARK_MAIN();